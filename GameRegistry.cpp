@@ -0,0 +1,53 @@
+#include "GameRegistry.h"
+
+static_assert((GameRegistry::SHARDS & (GameRegistry::SHARDS - 1)) == 0, "shard index is taken by mask");
+
+GameEntry::GameEntry(Game game, std::optional<Bot> bot)
+        : game(std::move(game)), bot(std::move(bot)) {}
+
+GameRegistry::GameRegistry() : shards(new Shard[SHARDS]) {}
+
+GameRegistry::Shard& GameRegistry::ShardOf(unsigned int lobby_id) const {
+    // Номера лобби четные, младший бит - цвет игрока
+    return shards[(lobby_id >> 1) & (SHARDS - 1)];
+}
+
+std::shared_ptr<GameEntry> GameRegistry::Emplace(unsigned int lobby_id, Game game, std::optional<Bot> bot) {
+    // Запись создается до блокировки, под блокировкой только вставка указателя
+    auto entry = std::make_shared<GameEntry>(std::move(game), std::move(bot));
+    Shard& shard = ShardOf(lobby_id);
+    std::unique_lock lock(shard.mutex);
+    return shard.games.emplace(lobby_id, entry).second ? entry : nullptr;
+}
+
+std::shared_ptr<GameEntry> GameRegistry::Find(unsigned int lobby_id) const {
+    Shard& shard = ShardOf(lobby_id);
+    std::shared_lock lock(shard.mutex);
+    auto it = shard.games.find(lobby_id);
+    return it != shard.games.end() ? it->second : nullptr;
+}
+
+bool GameRegistry::Erase(unsigned int lobby_id) {
+    std::shared_ptr<GameEntry> entry;
+    Shard& shard = ShardOf(lobby_id);
+    {
+        std::unique_lock lock(shard.mutex);
+        auto it = shard.games.find(lobby_id);
+        if (it == shard.games.end()) {
+            return false;
+        }
+        // Партия освобождается после снятия блокировки
+        entry = std::move(it->second);
+        shard.games.erase(it);
+    }
+    return true;
+}
+
+size_t GameRegistry::Size() const {
+    size_t size = 0;
+    for (size_t i = 0; i < SHARDS; ++i) {
+        std::shared_lock lock(shards[i].mutex);
+        size += shards[i].games.size();
+    }
+    return size;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "engine/Bot.h"
+#include "engine/Game.h"
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class Session;
+
+/**
+ * Партия вместе с ботом, если партия с ботом. Запись живет, пока на нее есть shared_ptr,
+ * поэтому удаление из реестра не ломает запросы, уже получившие запись.
+ */
+struct GameEntry {
+    GameEntry(Game game, std::optional<Bot> bot);
+
+    // Защищает game и bot: ходы в разных партиях не ждут друг друга
+    std::mutex mutex;
+    Game game;
+    std::optional<Bot> bot;
+    // Предложение отменить ход (GAME TAKEBACK): цвет предложившего и версия доски, при которой оно сделано.
+    // Ход соперника или отмена хода меняют версию, и предложение больше не действует
+    std::optional<Color> takeback_offer;
+    uint64_t takeback_version = 0;
+    // Партия удалена из реестра; запросы, получившие запись раньше, отвечают "-" и ничего не пишут в журнал
+    bool evicted = false;
+    // Соединения, подписанные на события партии (GAME SUBSCRIBE), и цвет игрока каждого
+    std::vector<std::pair<std::weak_ptr<Session>, Color>> subscribers;
+};
+
+/**
+ * Партии по номеру лобби. Номера разложены по SHARDS независимым таблицам, у каждой свой
+ * shared_mutex: поиск берет блокировку только своей таблицы и только на время поиска,
+ * рехеш одной таблицы не задерживает остальные.
+ */
+class GameRegistry {
+public:
+    static constexpr size_t SHARDS = 64;
+
+    GameRegistry();
+
+    // nullptr, если партия с таким номером уже есть
+    std::shared_ptr<GameEntry> Emplace(unsigned int lobby_id, Game game, std::optional<Bot> bot = std::nullopt);
+    // nullptr, если партии нет
+    std::shared_ptr<GameEntry> Find(unsigned int lobby_id) const;
+    bool Erase(unsigned int lobby_id);
+    size_t Size() const;
+
+    /**
+     * Вызывает visit(lobby_id, entry) для каждой партии. Таблица блокируется только на время
+     * копирования указателей из нее, visit может блокировать партию и вызывать Erase.
+     */
+    template<class Visit>
+    void ForEach(Visit&& visit) const {
+        std::vector<std::pair<unsigned int, std::shared_ptr<GameEntry>>> entries;
+        for (size_t i = 0; i < SHARDS; ++i) {
+            entries.clear();
+            {
+                std::shared_lock lock(shards[i].mutex);
+                entries.assign(shards[i].games.begin(), shards[i].games.end());
+            }
+            for (const auto& [lobby_id, entry] : entries) {
+                visit(lobby_id, entry);
+            }
+        }
+    }
+private:
+    // Каждая таблица на своей строке кэша, чтобы блокировки соседних не мешали друг другу
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<unsigned int, std::shared_ptr<GameEntry>> games;
+    };
+
+    Shard& ShardOf(unsigned int lobby_id) const;
+
+    std::unique_ptr<Shard[]> shards;
+};
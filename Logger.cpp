@@ -0,0 +1,149 @@
+#include "Logger.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+namespace {
+
+    constexpr const char* LEVEL_NAMES[] = {"DEBUG", "INFO", "WARNING", "ERROR", "OFF"};
+
+    // Пауза потока записи, когда все кольца пусты
+    constexpr std::chrono::milliseconds WRITER_IDLE{5};
+
+}
+
+const char* LogLevelName(LogLevel level) {
+    return LEVEL_NAMES[static_cast<size_t>(level)];
+}
+
+
+Logger::Record* Logger::Ring::Reserve() {
+    uint64_t position = tail.load(std::memory_order_relaxed);
+    if (position - head.load(std::memory_order_acquire) == RING_SIZE) {
+        return nullptr;
+    }
+    return &records[position % RING_SIZE];
+}
+
+void Logger::Ring::Commit() {
+    tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+
+Logger& Logger::Instance() {
+    // Не разрушается при выходе: в журнал могут писать отсоединенные потоки
+    static Logger* logger = new Logger();
+    return *logger;
+}
+
+Logger::Logger() : file(stdout) {
+    if (const char* path = std::getenv("FOG_CHESS_LOG"); path != nullptr && std::strcmp(path, "-") != 0) {
+        if (FILE* opened = std::fopen(path, "a")) {
+            file = opened;
+        } else {
+            std::fprintf(stderr, "Cannot open log file %s, logging to stdout\n", path);
+        }
+    }
+    if (const char* name = std::getenv("FOG_CHESS_LOG_LEVEL")) {
+        for (size_t i = 0; i < std::size(LEVEL_NAMES); ++i) {
+            if (std::strcmp(name, LEVEL_NAMES[i]) == 0) {
+                level.store(static_cast<LogLevel>(i), std::memory_order_relaxed);
+            }
+        }
+    }
+
+    output.reserve(RING_SIZE * (RECORD_SIZE + 48));
+    std::thread([this]() {
+        WriterLoop();
+    }).detach();
+}
+
+void Logger::SetLevel(LogLevel level) {
+    this->level.store(level, std::memory_order_relaxed);
+}
+
+LogLevel Logger::GetLevel() const {
+    return level.load(std::memory_order_relaxed);
+}
+
+uint64_t Logger::Written() const {
+    return written.load(std::memory_order_relaxed);
+}
+
+uint64_t Logger::Dropped() const {
+    return dropped.load(std::memory_order_relaxed);
+}
+
+Logger::Ring& Logger::ThreadRing() {
+    thread_local Ring* ring = nullptr;
+    if (ring == nullptr) {
+        auto created = std::make_unique<Ring>();
+        ring = created.get();
+        std::lock_guard<std::mutex> guard(rings_mutex);
+        rings.push_back(std::move(created));
+    }
+    return *ring;
+}
+
+void Logger::WriterLoop() {
+    for (;;) {
+        if (Drain() == 0) {
+            std::this_thread::sleep_for(WRITER_IDLE);
+        }
+    }
+}
+
+void Logger::Flush() {
+    Drain();
+}
+
+size_t Logger::Drain() {
+    std::lock_guard<std::mutex> drain_guard(drain_mutex);
+    size_t count = 0;
+    output.clear();
+
+    // Кольца только добавляются, поэтому список можно пройти по снимку размера
+    size_t ring_count;
+    {
+        std::lock_guard<std::mutex> guard(rings_mutex);
+        ring_count = rings.size();
+    }
+    for (size_t i = 0; i < ring_count; ++i) {
+        Ring* ring;
+        {
+            std::lock_guard<std::mutex> guard(rings_mutex);
+            ring = rings[i].get();
+        }
+
+        uint64_t head = ring->head.load(std::memory_order_relaxed);
+        uint64_t tail = ring->tail.load(std::memory_order_acquire);
+        for (; head != tail; ++head) {
+            const Record& record = ring->records[head % RING_SIZE];
+
+            // "2026-01-31 12:00:00.123456 INFO сообщение"
+            auto since_epoch = record.time.time_since_epoch();
+            std::time_t seconds = std::chrono::duration_cast<std::chrono::seconds>(since_epoch).count();
+            auto micros = std::chrono::duration_cast<std::chrono::microseconds>(since_epoch).count() % 1000000;
+            std::tm tm{};
+            gmtime_r(&seconds, &tm);
+            char prefix[64];
+            size_t size = std::strftime(prefix, sizeof(prefix), "%Y-%m-%d %H:%M:%S", &tm);
+            size += static_cast<size_t>(std::snprintf(prefix + size, sizeof(prefix) - size, ".%06lld %s ",
+                                                      static_cast<long long>(micros), LogLevelName(record.level)));
+
+            output.insert(output.end(), prefix, prefix + size);
+            output.insert(output.end(), record.text, record.text + record.size);
+            output.push_back('\n');
+            ++count;
+        }
+        ring->head.store(tail, std::memory_order_release);
+    }
+
+    if (count != 0) {
+        std::fwrite(output.data(), 1, output.size(), file);
+        std::fflush(file);
+        written.fetch_add(count, std::memory_order_relaxed);
+    }
+    return count;
+}
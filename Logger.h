@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+enum class LogLevel : uint8_t {
+    DEBUG,
+    INFO,
+    WARNING,
+    ERROR,
+    OFF
+};
+
+const char* LogLevelName(LogLevel level);
+
+/**
+ * Асинхронный журнал. Каждый поток пишет записи в свое кольцо фиксированного размера
+ * без блокировок; фоновый поток забирает записи из всех колец и пишет их в файл пачками.
+ * Если кольцо заполнено, запись отбрасывается и учитывается в Dropped - запрос не ждет журнал.
+ * Файл задается переменной окружения FOG_CHESS_LOG (по умолчанию stdout),
+ * начальный уровень - FOG_CHESS_LOG_LEVEL (DEBUG, INFO, WARNING, ERROR, OFF; по умолчанию INFO).
+ */
+class Logger {
+public:
+    // Длина одной записи, более длинные сообщения обрезаются
+    static constexpr size_t RECORD_SIZE = 256;
+    // Записей в кольце одного потока
+    static constexpr size_t RING_SIZE = 1024;
+
+    static Logger& Instance();
+
+    bool Enabled(LogLevel level) const {
+        return level >= this->level.load(std::memory_order_relaxed);
+    }
+    void SetLevel(LogLevel level);
+    LogLevel GetLevel() const;
+
+    // Сообщение - склейка parts (все приводятся к std::string_view)
+    template<class... Parts>
+    void Write(LogLevel level, const Parts&... parts) {
+        Ring& ring = ThreadRing();
+        Record* record = ring.Reserve();
+        if (record == nullptr) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        record->time = std::chrono::system_clock::now();
+        record->level = level;
+        record->size = 0;
+        (Append(*record, std::string_view(parts)), ...);
+        ring.Commit();
+    }
+
+    // Дописывает в файл все, что успели записать потоки к моменту вызова
+    void Flush();
+
+    uint64_t Written() const;
+    uint64_t Dropped() const;
+private:
+    struct Record {
+        std::chrono::system_clock::time_point time;
+        LogLevel level;
+        uint16_t size;
+        char text[RECORD_SIZE];
+    };
+
+    // Кольцо одного потока: пишет только владелец, читает только поток записи
+    struct Ring {
+        Record* Reserve();
+        void Commit();
+
+        // Индексы на разных строках кэша, чтобы запись и чтение не мешали друг другу
+        alignas(64) std::atomic<uint64_t> head{0};
+        alignas(64) std::atomic<uint64_t> tail{0};
+        Record records[RING_SIZE];
+    };
+
+    Logger();
+
+    static void Append(Record& record, std::string_view part) {
+        size_t size = std::min(part.size(), RECORD_SIZE - record.size);
+        std::copy(part.data(), part.data() + size, record.text + record.size);
+        record.size = static_cast<uint16_t>(record.size + size);
+    }
+
+    Ring& ThreadRing();
+    void WriterLoop();
+    // Переносит записи из колец в файл, возвращает число записей
+    size_t Drain();
+
+    std::atomic<LogLevel> level{LogLevel::INFO};
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> dropped{0};
+
+    // Кольца создаются при первой записи потока и живут до конца программы
+    std::mutex rings_mutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+
+    // Drain выполняет один поток за раз
+    std::mutex drain_mutex;
+    FILE* file;
+    std::vector<char> output;
+};
+
+// Запись, если уровень журнала ее пропускает; сообщение не собирается, если уровень выключен
+template<class... Parts>
+void Log(LogLevel level, const Parts&... parts) {
+    Logger& logger = Logger::Instance();
+    if (logger.Enabled(level)) {
+        logger.Write(level, parts...);
+    }
+}
@@ -0,0 +1,177 @@
+#include "Metrics.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+    constexpr const char* ENGINE_OPERATION_NAMES[] = {"make_move", "fow_fen"};
+
+    // Границы гистограмм для Prometheus: 2^8 нс (256 нс) ... 2^36 нс (~69 с) через степень четверки
+    constexpr int FIRST_BOUND_POWER = 8;
+    constexpr int LAST_BOUND_POWER = 36;
+
+    void AppendNumber(std::string& out, double value) {
+        char buffer[32];
+        int size = std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+        out.append(buffer, static_cast<size_t>(size));
+    }
+
+    void AppendHeader(std::string& out, const char* name, const char* type, const char* help) {
+        out += "# HELP ";
+        out += name;
+        out += ' ';
+        out += help;
+        out += "\n# TYPE ";
+        out += name;
+        out += ' ';
+        out += type;
+        out += '\n';
+    }
+
+}
+
+
+Metrics& Metrics::Instance() {
+    // Не разрушается при выходе: счетчики пишут и отсоединенные потоки
+    static Metrics* metrics = new Metrics();
+    return *metrics;
+}
+
+size_t Metrics::BucketOf(uint64_t nanoseconds) {
+    if (nanoseconds < SUB_BUCKETS) {
+        return static_cast<size_t>(nanoseconds);
+    }
+    // Старший бит задает степень двойки, следующие три - интервал внутри нее
+    int power = 63 - __builtin_clzll(nanoseconds);
+    size_t index = static_cast<size_t>(power - 2) * SUB_BUCKETS + ((nanoseconds >> (power - 3)) & (SUB_BUCKETS - 1));
+    return std::min(index, BUCKETS - 1);
+}
+
+void Metrics::Series::Record(uint64_t duration, bool error) {
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (error) {
+        errors.store(errors.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    nanoseconds.store(nanoseconds.load(std::memory_order_relaxed) + duration, std::memory_order_relaxed);
+    if (duration > max_nanoseconds.load(std::memory_order_relaxed)) {
+        max_nanoseconds.store(duration, std::memory_order_relaxed);
+    }
+    std::atomic<uint64_t>& bucket = buckets[BucketOf(duration)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+Metrics::ThreadBlock& Metrics::ThreadMetrics() {
+    thread_local ThreadBlock* block = nullptr;
+    if (block == nullptr) {
+        auto created = std::make_unique<ThreadBlock>();
+        block = created.get();
+        std::lock_guard<std::mutex> guard(blocks_mutex);
+        blocks.push_back(std::move(created));
+    }
+    return *block;
+}
+
+void Metrics::RecordRequest(Command command, std::chrono::nanoseconds duration, bool error) {
+    size_t series = std::min(static_cast<size_t>(command), COMMAND_COUNT);
+    ThreadMetrics().series[series].Record(static_cast<uint64_t>(std::max<int64_t>(0, duration.count())), error);
+}
+
+void Metrics::RecordEngine(EngineOperation operation, std::chrono::nanoseconds duration) {
+    size_t series = REQUEST_SERIES + static_cast<size_t>(operation);
+    ThreadMetrics().series[series].Record(static_cast<uint64_t>(std::max<int64_t>(0, duration.count())), false);
+}
+
+void Metrics::SessionOpened() {
+    sessions.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::SessionClosed() {
+    sessions.fetch_sub(1, std::memory_order_relaxed);
+}
+
+Metrics::Totals Metrics::Collect(size_t series) const {
+    Totals totals;
+    std::lock_guard<std::mutex> guard(blocks_mutex);
+    for (const auto& block : blocks) {
+        const Series& source = block->series[series];
+        totals.count += source.count.load(std::memory_order_relaxed);
+        totals.errors += source.errors.load(std::memory_order_relaxed);
+        totals.nanoseconds += source.nanoseconds.load(std::memory_order_relaxed);
+        totals.max_nanoseconds = std::max(totals.max_nanoseconds, source.max_nanoseconds.load(std::memory_order_relaxed));
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            totals.buckets[i] += source.buckets[i].load(std::memory_order_relaxed);
+        }
+    }
+    return totals;
+}
+
+Metrics::RequestTotals Metrics::GetRequestTotals() const {
+    RequestTotals result;
+    for (size_t series = 0; series < REQUEST_SERIES; ++series) {
+        Totals totals = Collect(series);
+        result.count += totals.count;
+        result.nanoseconds += totals.nanoseconds;
+        result.max_nanoseconds = std::max(result.max_nanoseconds, totals.max_nanoseconds);
+    }
+    return result;
+}
+
+void Metrics::WritePrometheus(std::string& out) const {
+    std::array<Totals, SERIES> totals;
+    for (size_t series = 0; series < SERIES; ++series) {
+        totals[series] = Collect(series);
+    }
+
+    auto label = [](size_t series) -> std::string {
+        if (series < REQUEST_SERIES) {
+            return std::string("command=\"") + CommandName(static_cast<Command>(series)) + "\"";
+        }
+        return std::string("operation=\"") + ENGINE_OPERATION_NAMES[series - REQUEST_SERIES] + "\"";
+    };
+
+    auto write_histogram = [&](const char* name, size_t first, size_t last) {
+        for (size_t series = first; series < last; ++series) {
+            const Totals& series_totals = totals[series];
+            std::string labels = label(series);
+            // Интервал с номером (power - 2) * 8 начинается ровно с 2^power нс
+            uint64_t cumulative = 0;
+            size_t bucket = 0;
+            for (int power = FIRST_BOUND_POWER; power <= LAST_BOUND_POWER; power += 2) {
+                size_t end = static_cast<size_t>(power - 2) * SUB_BUCKETS;
+                for (; bucket < end; ++bucket) {
+                    cumulative += series_totals.buckets[bucket];
+                }
+                out += name;
+                out += "_bucket{" + labels + ",le=\"";
+                AppendNumber(out, static_cast<double>(1ULL << power) * 1e-9);
+                out += "\"} " + std::to_string(cumulative) + "\n";
+            }
+            out += name;
+            out += "_bucket{" + labels + ",le=\"+Inf\"} " + std::to_string(series_totals.count) + "\n";
+            out += name;
+            out += "_sum{" + labels + "} ";
+            AppendNumber(out, static_cast<double>(series_totals.nanoseconds) * 1e-9);
+            out += "\n";
+            out += name;
+            out += "_count{" + labels + "} " + std::to_string(series_totals.count) + "\n";
+        }
+    };
+
+    AppendHeader(out, "fog_chess_requests_total", "counter", "Requests by command.");
+    for (size_t series = 0; series < REQUEST_SERIES; ++series) {
+        out += "fog_chess_requests_total{" + label(series) + "} " + std::to_string(totals[series].count) + "\n";
+    }
+    AppendHeader(out, "fog_chess_request_errors_total", "counter", "Requests answered with \"-\".");
+    for (size_t series = 0; series < REQUEST_SERIES; ++series) {
+        out += "fog_chess_request_errors_total{" + label(series) + "} " + std::to_string(totals[series].errors) + "\n";
+    }
+    AppendHeader(out, "fog_chess_request_duration_seconds", "histogram",
+                 "Time from reading a request to its response, including the wait for the game strand.");
+    write_histogram("fog_chess_request_duration_seconds", 0, REQUEST_SERIES);
+    AppendHeader(out, "fog_chess_engine_duration_seconds", "histogram", "Time of engine calls made by requests and bots.");
+    write_histogram("fog_chess_engine_duration_seconds", REQUEST_SERIES, SERIES);
+
+    AppendHeader(out, "fog_chess_sessions", "gauge", "Open websocket sessions.");
+    out += "fog_chess_sessions " + std::to_string(sessions.load(std::memory_order_relaxed)) + "\n";
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "Protocol.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Операции движка, время которых измеряется отдельно от запросов
+enum class EngineOperation : uint8_t {
+    MAKE_MOVE,
+    FOW_FEN,
+    COUNT
+};
+
+/**
+ * Счетчики и гистограммы времени запросов по командам и операций движка.
+ * Каждый поток пишет в свой блок счетчиков (только он, без атомарных сложений между потоками),
+ * чтение суммирует блоки всех потоков.
+ * Гистограммы логарифмические, как в HdrHistogram: на каждую степень двойки 8 интервалов
+ * (точность 12.5%). Интервалы 0-7 - по одной наносекунде, интервал (power - 2) * 8 начинается
+ * с 2^power нс, так что 320 интервалов доходят до 2^42 нс (~73 минуты); все, что дольше,
+ * попадает в последний.
+ */
+class Metrics {
+public:
+    static constexpr size_t SUB_BUCKETS = 8;
+    static constexpr size_t BUCKETS = 320;
+
+    static Metrics& Instance();
+
+    // Command::COUNT - запрос, который не удалось разобрать
+    void RecordRequest(Command command, std::chrono::nanoseconds duration, bool error);
+    void RecordEngine(EngineOperation operation, std::chrono::nanoseconds duration);
+
+    void SessionOpened();
+    void SessionClosed();
+
+    // Сумма по всем командам: запросов, общее и наибольшее время
+    struct RequestTotals {
+        uint64_t count = 0;
+        uint64_t nanoseconds = 0;
+        uint64_t max_nanoseconds = 0;
+    };
+    RequestTotals GetRequestTotals() const;
+
+    // Счетчики в текстовом формате Prometheus (без показателей, которые добавляет Server)
+    void WritePrometheus(std::string& out) const;
+
+    static size_t BucketOf(uint64_t nanoseconds);
+private:
+    // Ряды: команды, неразобранные запросы, операции движка
+    static constexpr size_t REQUEST_SERIES = COMMAND_COUNT + 1;
+    static constexpr size_t SERIES = REQUEST_SERIES + static_cast<size_t>(EngineOperation::COUNT);
+
+    // Счетчики одного ряда. Пишет только поток-владелец блока, поэтому хватает load + store.
+    struct Series {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> errors{0};
+        std::atomic<uint64_t> nanoseconds{0};
+        std::atomic<uint64_t> max_nanoseconds{0};
+        std::array<std::atomic<uint64_t>, BUCKETS> buckets{};
+
+        void Record(uint64_t duration, bool error);
+    };
+
+    // Сумма ряда по всем потокам
+    struct Totals {
+        uint64_t count = 0;
+        uint64_t errors = 0;
+        uint64_t nanoseconds = 0;
+        uint64_t max_nanoseconds = 0;
+        std::array<uint64_t, BUCKETS> buckets{};
+    };
+
+    struct alignas(64) ThreadBlock {
+        std::array<Series, SERIES> series;
+    };
+
+    Metrics() = default;
+
+    ThreadBlock& ThreadMetrics();
+    Totals Collect(size_t series) const;
+
+    std::atomic<int64_t> sessions{0};
+
+    // Блоки создаются при первой записи потока и живут до конца программы
+    mutable std::mutex blocks_mutex;
+    std::vector<std::unique_ptr<ThreadBlock>> blocks;
+};
+
+// Выполняет call и записывает его время как операцию движка
+template<class Call>
+auto Timed(EngineOperation operation, Call&& call) {
+    auto started = std::chrono::steady_clock::now();
+    if constexpr (std::is_void_v<decltype(call())>) {
+        call();
+        Metrics::Instance().RecordEngine(operation, std::chrono::steady_clock::now() - started);
+    } else {
+        auto result = call();
+        Metrics::Instance().RecordEngine(operation, std::chrono::steady_clock::now() - started);
+        return result;
+    }
+}
@@ -0,0 +1,412 @@
+#include "MoveLog.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+    thread_local uint64_t thread_sequence = 0;
+
+    uint16_t EncodeMove(const Move& move) {
+        return static_cast<uint16_t>(move.from | move.to << 6 | static_cast<unsigned int>(move.promotion) << 12);
+    }
+
+    bool DecodeMove(unsigned int code, Move& move) {
+        unsigned int promotion = (code >> 12) & 7;
+        if (code >> 15 || promotion > static_cast<unsigned int>(Figure::KING)) {
+            return false;
+        }
+        move = {static_cast<uint8_t>(code & 63), static_cast<uint8_t>((code >> 6) & 63), static_cast<Figure>(promotion)};
+        return true;
+    }
+
+    template<class T>
+    bool ParseNumber(std::string_view& rest, T& value) {
+        if (rest.empty() || rest[0] != ' ') {
+            return false;
+        }
+        auto [ptr, ec] = std::from_chars(rest.data() + 1, rest.data() + rest.size(), value);
+        if (ec != std::errc()) {
+            return false;
+        }
+        rest.remove_prefix(static_cast<size_t>(ptr - rest.data()));
+        return true;
+    }
+
+    constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+    void FormatPosition(const PackedPosition& position, std::string& line) {
+        line += " P";
+        for (size_t i = 0; i < PackedPosition::SIZE; ++i) {
+            line += HEX_DIGITS[position.Data()[i] >> 4];
+            line += HEX_DIGITS[position.Data()[i] & 15];
+        }
+    }
+
+    bool ParsePosition(std::string_view& rest, PackedPosition& position) {
+        if (rest.size() < 2 + PackedPosition::SIZE * 2 || rest.substr(0, 2) != " P") {
+            return false;
+        }
+        uint8_t bytes[PackedPosition::SIZE];
+        for (size_t i = 0; i < PackedPosition::SIZE; ++i) {
+            auto [ptr, ec] = std::from_chars(rest.data() + 2 + i * 2, rest.data() + 4 + i * 2, bytes[i], 16);
+            if (ec != std::errc() || ptr != rest.data() + 4 + i * 2) {
+                return false;
+            }
+        }
+        std::memcpy(&position, bytes, sizeof(PackedPosition));
+        rest.remove_prefix(2 + PackedPosition::SIZE * 2);
+        return true;
+    }
+
+    // Содержимое файла до последнего '\n': недописанная строка отбрасывается
+    std::string ReadLines(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        data.resize(data.rfind('\n') + 1);
+        return data;
+    }
+
+    bool HasCheckpoint(std::string_view data) {
+        return data.substr(0, 2) == "K\n" || data.find("\nK\n") != std::string_view::npos;
+    }
+
+    bool WriteAll(int fd, std::string_view data) {
+        while (!data.empty()) {
+            ssize_t written = ::write(fd, data.data(), data.size());
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            data.remove_prefix(static_cast<size_t>(written));
+        }
+        return true;
+    }
+
+    // Запись о новом файле журнала тоже должна пережить сбой
+    void SyncDirectory(const std::filesystem::path& directory) {
+        int fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd >= 0) {
+            ::fsync(fd);
+            ::close(fd);
+        }
+    }
+
+}
+
+
+std::string LogRecord::Format() const {
+    std::string line(1, static_cast<char>(type));
+    if (type == LogRecordType::CHECKPOINT) {
+        return line;
+    }
+    line += ' ';
+    line += std::to_string(type == LogRecordType::NEXT_ID ? value : lobby_id);
+    switch (type) {
+        case LogRecordType::LOBBY_CREATE:
+            line += ' ';
+            line += nickname;
+            break;
+        case LogRecordType::BOT_GAME:
+            line += ' ' + std::to_string(value);
+            break;
+        case LogRecordType::MOVE:
+            line += ' ' + std::to_string(EncodeMove(move));
+            break;
+        case LogRecordType::GAME:
+            line += ' ' + std::to_string(value);
+            if (position.has_value()) {
+                FormatPosition(*position, line);
+            }
+            for (const Move& played : moves) {
+                line += ' ' + std::to_string(EncodeMove(played));
+            }
+            break;
+        default:
+            break;
+    }
+    return line;
+}
+
+bool LogRecord::Parse(std::string_view line, LogRecord& record) {
+    record = LogRecord();
+    if (line.empty()) {
+        return false;
+    }
+    record.type = static_cast<LogRecordType>(line[0]);
+    std::string_view rest = line.substr(1);
+    switch (record.type) {
+        case LogRecordType::CHECKPOINT:
+            return rest.empty();
+        case LogRecordType::NEXT_ID:
+            return ParseNumber(rest, record.value) && rest.empty();
+        case LogRecordType::LOBBY_CREATE:
+            // Ник - остаток строки, он может быть пустым
+            if (!ParseNumber(rest, record.lobby_id) || rest.empty() || rest[0] != ' ') {
+                return false;
+            }
+            record.nickname = rest.substr(1);
+            return true;
+        case LogRecordType::LOBBY_DELETE:
+        case LogRecordType::LOBBY_ENTER:
+        case LogRecordType::TAKEBACK:
+        case LogRecordType::EVICT:
+            return ParseNumber(rest, record.lobby_id) && rest.empty();
+        case LogRecordType::BOT_GAME:
+            return ParseNumber(rest, record.lobby_id) && ParseNumber(rest, record.value) && rest.empty();
+        case LogRecordType::MOVE: {
+            unsigned int code;
+            return ParseNumber(rest, record.lobby_id) && ParseNumber(rest, code) && rest.empty() &&
+                   DecodeMove(code, record.move);
+        }
+        case LogRecordType::GAME: {
+            if (!ParseNumber(rest, record.lobby_id) || !ParseNumber(rest, record.value)) {
+                return false;
+            }
+            if (rest.substr(0, 2) == " P") {
+                record.position.emplace();
+                if (!ParsePosition(rest, *record.position)) {
+                    return false;
+                }
+            }
+            while (!rest.empty()) {
+                unsigned int code;
+                Move move;
+                if (!ParseNumber(rest, code) || !DecodeMove(code, move)) {
+                    return false;
+                }
+                record.moves.push_back(move);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+
+std::string MoveLog::SegmentPath(uint64_t number) const {
+    return path + "." + std::to_string(number);
+}
+
+bool MoveLog::Open(const std::string& path, const std::function<void(const LogRecord&)>& replay) {
+    namespace fs = std::filesystem;
+    this->path = path;
+
+    // Номера файлов журнала "<path>.<номер>" по возрастанию
+    fs::path directory = fs::path(path).parent_path();
+    std::string prefix = fs::path(path).filename().string() + ".";
+    std::vector<uint64_t> segments;
+    std::error_code ec;
+    for (const fs::directory_entry& file : fs::directory_iterator(directory.empty() ? "." : directory, ec)) {
+        std::string name = file.path().filename().string();
+        uint64_t number;
+        const char* end = name.data() + name.size();
+        if (name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0) {
+            auto [ptr, parsed] = std::from_chars(name.data() + prefix.size(), end, number);
+            if (parsed == std::errc() && ptr == end && number != 0) {
+                segments.push_back(number);
+            }
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+
+    std::vector<std::string> contents;
+    contents.reserve(segments.size());
+    size_t start = 0;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        contents.push_back(ReadLines(SegmentPath(segments[i])));
+        if (HasCheckpoint(contents.back())) {
+            start = i;
+        }
+    }
+
+    uint64_t replayed = 0;
+    size_t records = 0;
+    for (size_t i = start; i < segments.size(); ++i) {
+        std::string_view data = contents[i];
+        while (!data.empty()) {
+            size_t end = data.find('\n');
+            LogRecord record;
+            if (LogRecord::Parse(data.substr(0, end), record)) {
+                replay(record);
+                ++records;
+            } else {
+                Log(LogLevel::WARNING, "Move log: skipping damaged record ", data.substr(0, end));
+            }
+            data.remove_prefix(end + 1);
+        }
+        replayed += contents[i].size();
+    }
+
+    segment = segments.empty() ? 1 : segments.back();
+    fd = ::open(SegmentPath(segment).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        Log(LogLevel::ERROR, "Cannot open move log ", SegmentPath(segment), ": ", std::strerror(errno));
+        return false;
+    }
+    // Недописанная при сбое строка отрезается, чтобы новые записи начинались с новой строки
+    if (!segments.empty() && ::ftruncate(fd, static_cast<off_t>(contents.back().size())) != 0) {
+        Log(LogLevel::ERROR, "Cannot truncate move log: ", std::strerror(errno));
+    }
+    if (segments.empty()) {
+        SyncDirectory(directory);
+    }
+    RemoveSegmentsBefore(start < segments.size() ? segments[start] : segment);
+
+    bytes_since_checkpoint = replayed;
+    Log(LogLevel::INFO, "Move log: replayed ", std::to_string(records), " records");
+
+    std::thread([this]() {
+        WriterLoop();
+    }).detach();
+    return true;
+}
+
+uint64_t MoveLog::Append(const LogRecord& record) {
+    if (!IsOpen()) {
+        return 0;
+    }
+    // Строка собирается до блокировки, под блокировкой только копирование
+    std::string line = record.Format();
+    line += '\n';
+
+    std::lock_guard<std::mutex> guard(mutex);
+    if (pending.empty()) {
+        cv.notify_one();
+    }
+    pending += line;
+    (in_checkpoint ? checkpoint_bytes : bytes_since_checkpoint) += line.size();
+    thread_sequence = ++appended;
+    return appended;
+}
+
+uint64_t MoveLog::ThreadSequence() {
+    return thread_sequence;
+}
+
+void MoveLog::AfterCommit(uint64_t sequence, std::function<void(bool)> done) {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (sequence > durable && !IsFailed()) {
+            waiters.emplace_back(sequence, std::move(done));
+            return;
+        }
+    }
+    done(sequence <= durable);
+}
+
+void MoveLog::BeginCheckpoint() {
+    std::lock_guard<std::mutex> guard(mutex);
+    rotate_at = pending.size();
+    in_checkpoint = true;
+    checkpoint_bytes = 0;
+    cv.notify_one();
+}
+
+void MoveLog::EndCheckpoint() {
+    LogRecord record;
+    record.type = LogRecordType::CHECKPOINT;
+    std::string line = record.Format();
+    line += '\n';
+
+    // "K" и признак конца точки попадают в одну пачку потока записи
+    std::lock_guard<std::mutex> guard(mutex);
+    pending += line;
+    checkpoint_bytes += line.size();
+    thread_sequence = ++appended;
+    finish_checkpoint = true;
+    in_checkpoint = false;
+    bytes_since_checkpoint = 0;
+    cv.notify_one();
+}
+
+std::pair<uint64_t, uint64_t> MoveLog::GetGrowth() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return {bytes_since_checkpoint, checkpoint_bytes};
+}
+
+void MoveLog::Rotate() {
+    int next = ::open(SegmentPath(segment + 1).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (next < 0) {
+        Log(LogLevel::ERROR, "Cannot create move log ", SegmentPath(segment + 1), ": ", std::strerror(errno));
+        return;
+    }
+    SyncDirectory(std::filesystem::path(path).parent_path());
+    ::close(fd);
+    fd = next;
+    ++segment;
+}
+
+void MoveLog::RemoveSegmentsBefore(uint64_t number) {
+    std::error_code ec;
+    for (uint64_t old = number; old-- > 1 && std::filesystem::remove(SegmentPath(old), ec);) {
+    }
+}
+
+void MoveLog::WriterLoop() {
+    std::string batch;
+    std::vector<std::pair<std::function<void(bool)>, bool>> ready;
+    for (;;) {
+        size_t rotate;
+        bool finish;
+        uint64_t sequence;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this]() { return !pending.empty() || rotate_at != std::string::npos; });
+            batch.clear();
+            batch.swap(pending);
+            rotate = std::exchange(rotate_at, std::string::npos);
+            finish = std::exchange(finish_checkpoint, false);
+            sequence = appended;
+        }
+
+        // Все записи пачки - один write и один fdatasync на файл. После ошибки файл не дописывается:
+        // за пропущенными записями повтор восстановил бы не то состояние, которое видели игроки
+        bool written = !IsFailed();
+        std::string_view rest = batch;
+        if (written && rotate != std::string::npos) {
+            written = WriteAll(fd, rest.substr(0, rotate)) && ::fdatasync(fd) == 0;
+            rest.remove_prefix(rotate);
+            if (written) {
+                Rotate();
+            }
+        }
+        written = written && WriteAll(fd, rest) && ::fdatasync(fd) == 0;
+        if (written && finish) {
+            RemoveSegmentsBefore(segment);
+        }
+        if (!written && !failed.exchange(true, std::memory_order_acq_rel)) {
+            Log(LogLevel::ERROR, "Move log write failed, changes are no longer accepted: ", std::strerror(errno));
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            if (written) {
+                durable = sequence;
+            }
+            auto done = std::partition(waiters.begin(), waiters.end(), [&](const auto& waiter) {
+                return written && waiter.first > sequence;
+            });
+            for (auto it = done; it != waiters.end(); ++it) {
+                ready.emplace_back(std::move(it->second), written);
+            }
+            waiters.erase(done, waiters.end());
+        }
+        for (auto& [callback, durable_record] : ready) {
+            callback(durable_record);
+        }
+        ready.clear();
+    }
+}
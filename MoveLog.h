@@ -0,0 +1,129 @@
+#pragma once
+
+#include "engine/MoveList.h"
+#include "engine/PackedPosition.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Тип записи журнала - первый символ ее строки
+enum class LogRecordType : char {
+    NEXT_ID = 'N',
+    LOBBY_CREATE = 'L',
+    LOBBY_DELETE = 'D',
+    LOBBY_ENTER = 'E',
+    BOT_GAME = 'B',
+    MOVE = 'M',
+    TAKEBACK = 'T',
+    EVICT = 'X',
+    GAME = 'G',
+    CHECKPOINT = 'K'
+};
+
+/**
+ * Запись журнала. Строка: тип, номер лобби и аргументы через пробел, ход - число
+ * (биты 0-5 откуда, 6-11 куда, 12-14 превращение, как в двоичном протоколе):
+ * "N <следующий номер лобби>", "L <лобби> <ник>", "D|E|T|X <лобби>", "B <лобби> <мс на ход бота>",
+ * "M <лобби> <ход>", "G <лобби> <мс на ход бота или 0> [P<позиция>] <ходы...>" - партия в контрольной точке:
+ * PackedPosition в 76 шестнадцатеричных цифрах и ходы после нее (см. Chessboard::GetSnapshot);
+ * без позиции - ходы с начальной позиции. "K" - контрольная точка записана целиком.
+ */
+struct LogRecord {
+    LogRecordType type = LogRecordType::NEXT_ID;
+    unsigned int lobby_id = 0;
+    // NEXT_ID - номер, BOT_GAME и GAME - время на ход бота, мс
+    uint32_t value = 0;
+    std::string_view nickname;
+    Move move{};
+    std::vector<Move> moves;
+    // GAME - позиция, с которой начинаются moves
+    std::optional<PackedPosition> position;
+
+    std::string Format() const;
+    // false, если строка повреждена
+    static bool Parse(std::string_view line, LogRecord& record);
+};
+
+/**
+ * Журнал предзаписи событий лобби и партий: после перезапуска сервер восстанавливает
+ * партии, повторяя записи. Записи дописываются в память, поток записи забирает все
+ * накопившееся и пишет одним write + fdatasync, так что одновременные ходы разделяют
+ * один fdatasync (group commit). AfterCommit позволяет отложить ответ до записи на диск.
+ * Если write или fdatasync не удались, журнал переходит в состояние ошибки до перезапуска:
+ * записи этой и следующих пачек не подтверждаются, а сервер перестает принимать изменения.
+ *
+ * Журнал - файлы "<path>.<номер>". Контрольная точка ограничивает его длину: после
+ * BeginCheckpoint записи идут в следующий файл, туда же вызывающий пишет состояние всех
+ * лобби и партий, EndCheckpoint дописывает "K" и после fdatasync удаляет прежние файлы.
+ * Повтор начинается с последнего файла с "K", а если точка не дописана - с прежнего файла.
+ * Записи о партии, попавшие в новый файл раньше ее снимка, повторяются поверх прежнего
+ * файла или пропускаются, если партии еще нет: снимок их уже содержит.
+ */
+class MoveLog {
+public:
+    MoveLog() = default;
+    MoveLog(const MoveLog&) = delete;
+    MoveLog& operator=(const MoveLog&) = delete;
+
+    /**
+     * Читает файлы журнала с последней контрольной точки, передает целые записи в replay,
+     * отрезает недописанную последнюю строку и запускает поток записи.
+     * @return false, если файл не открывается; журнал тогда выключен
+     */
+    bool Open(const std::string& path, const std::function<void(const LogRecord&)>& replay);
+    bool IsOpen() const {
+        return fd >= 0;
+    }
+    // Запись на диск не удалась - изменения больше не сохраняются
+    bool IsFailed() const {
+        return failed.load(std::memory_order_acquire);
+    }
+
+    // Номер записи; 0, если журнал выключен
+    uint64_t Append(const LogRecord& record);
+    // Номер последней записи, добавленной текущим потоком
+    static uint64_t ThreadSequence();
+    /**
+     * done(true) вызывается после fdatasync записи sequence, done(false) - если журнал не смог ее записать;
+     * сразу или из потока записи
+     */
+    void AfterCommit(uint64_t sequence, std::function<void(bool)> done);
+
+    void BeginCheckpoint();
+    void EndCheckpoint();
+    // Байт записано после последней контрольной точки и размер ее снимка
+    std::pair<uint64_t, uint64_t> GetGrowth() const;
+private:
+    std::string SegmentPath(uint64_t number) const;
+    void WriterLoop();
+    // Новый файл журнала для записей контрольной точки
+    void Rotate();
+    void RemoveSegmentsBefore(uint64_t number);
+
+    std::string path;
+    uint64_t segment = 0;
+    int fd = -1;
+
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    std::string pending;
+    // Начало записей контрольной точки в pending, npos - переключения нет
+    size_t rotate_at = std::string::npos;
+    bool finish_checkpoint = false;
+    bool in_checkpoint = false;
+    uint64_t appended = 0;
+    uint64_t durable = 0;
+    std::vector<std::pair<uint64_t, std::function<void(bool)>>> waiters;
+    std::atomic<bool> failed{false};
+    uint64_t bytes_since_checkpoint = 0;
+    uint64_t checkpoint_bytes = 0;
+};
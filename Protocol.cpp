@@ -0,0 +1,364 @@
+#include "Protocol.h"
+
+#include <algorithm>
+#include <charconv>
+#include <iterator>
+
+namespace {
+
+    enum class Arguments : uint8_t {
+        NONE,
+        ID,
+        OPTIONAL_ID,
+        ID_VERSION,
+        MOVE,
+        NICKNAME,
+        PROTOCOL,
+        BATCH,
+        LOG_LEVEL
+    };
+
+    struct CommandSpec {
+        std::string_view group;
+        std::string_view name;
+        Arguments arguments;
+    };
+
+    // Индекс - код команды; у PROTOCOL вместо имени - аргумент "TEXT" или "BINARY", у BATCH имени нет
+    constexpr CommandSpec COMMANDS[COMMAND_COUNT] = {
+            {"GET",      "LOBBIES",     Arguments::NONE},
+            {"GET",      "BOTSTATS",    Arguments::NONE},
+            {"LOBBY",    "ENTER",       Arguments::ID},
+            {"LOBBY",    "CREATE",      Arguments::NICKNAME},
+            {"LOBBY",    "BOT",         Arguments::OPTIONAL_ID},
+            {"LOBBY",    "REFRESH",     Arguments::ID},
+            {"LOBBY",    "DELETE",      Arguments::ID},
+            {"LOBBY",    "SUBSCRIBE",   Arguments::NONE},
+            {"LOBBY",    "UNSUBSCRIBE", Arguments::NONE},
+            {"GAME",     "BOARD",       Arguments::ID},
+            {"GAME",     "DELTA",       Arguments::ID_VERSION},
+            {"GAME",     "MOVE",        Arguments::MOVE},
+            {"GAME",     "TAKEBACK",    Arguments::ID},
+            {"GAME",     "RESULT",      Arguments::ID},
+            {"GAME",     "TURN",        Arguments::ID},
+            {"GAME",     "SUBSCRIBE",   Arguments::ID},
+            {"GAME",     "UNSUBSCRIBE", Arguments::ID},
+            {"PROTOCOL", "",            Arguments::PROTOCOL},
+            {"BATCH",    "",            Arguments::BATCH},
+            {"ADMIN",    "LOG",         Arguments::LOG_LEVEL},
+            {"GAME",     "ACCEPT",      Arguments::ID},
+    };
+
+    // Уровни журнала по значению LogLevel
+    constexpr std::string_view LOG_LEVELS[] = {"DEBUG", "INFO", "WARNING", "ERROR", "OFF"};
+
+    constexpr const char* COMMAND_NAMES[COMMAND_COUNT + 1] = {
+            "GET_LOBBIES", "GET_BOTSTATS",
+            "LOBBY_ENTER", "LOBBY_CREATE", "LOBBY_BOT", "LOBBY_REFRESH", "LOBBY_DELETE",
+            "LOBBY_SUBSCRIBE", "LOBBY_UNSUBSCRIBE",
+            "GAME_BOARD", "GAME_DELTA", "GAME_MOVE", "GAME_TAKEBACK", "GAME_RESULT", "GAME_TURN",
+            "GAME_SUBSCRIBE", "GAME_UNSUBSCRIBE",
+            "PROTOCOL", "BATCH", "ADMIN_LOG", "GAME_ACCEPT",
+            "INVALID"
+    };
+
+    // Фигуры превращения в тексте по индексу Figure
+    constexpr std::string_view FIGURE_LETTERS = "-PNBRQK";
+
+    bool IsSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    char ToUpper(char c) {
+        return c >= 'a' && c <= 'z' ? static_cast<char>(c - 'a' + 'A') : c;
+    }
+
+    bool IEquals(std::string_view lhs, std::string_view rhs) {
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            if (ToUpper(lhs[i]) != ToUpper(rhs[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Следующее слово сообщения, пустое в конце
+    std::string_view NextToken(std::string_view& rest) {
+        size_t begin = 0;
+        while (begin < rest.size() && IsSpace(rest[begin])) {
+            ++begin;
+        }
+        size_t end = begin;
+        while (end < rest.size() && !IsSpace(rest[end])) {
+            ++end;
+        }
+        std::string_view token = rest.substr(begin, end - begin);
+        rest.remove_prefix(end);
+        return token;
+    }
+
+    template<class T>
+    bool ParseNumber(std::string_view token, T& value) {
+        const char* end = token.data() + token.size();
+        auto [ptr, ec] = std::from_chars(token.data(), end, value);
+        return !token.empty() && ec == std::errc() && ptr == end;
+    }
+
+    // "E2" -> 12
+    bool ParseSquare(std::string_view token, uint8_t& square) {
+        if (token.size() != 2) {
+            return false;
+        }
+        char col = ToUpper(token[0]);
+        char row = token[1];
+        if (col < 'A' || col > 'H' || row < '1' || row > '8') {
+            return false;
+        }
+        square = static_cast<uint8_t>((row - '1') * 8 + (col - 'A'));
+        return true;
+    }
+
+    // Ник: от 1 до MAX_NICKNAME печатных символов без пробелов - одинаково в тексте и в двоичном виде
+    bool IsNickname(std::string_view nickname) {
+        if (nickname.empty() || nickname.size() > MAX_NICKNAME) {
+            return false;
+        }
+        for (char c : nickname) {
+            if (c <= ' ' || c > '~') {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Превращение в ходе: "-" (нет) или N, B, R, Q - в пешку и короля не превращаются
+    bool IsPromotion(Figure figure) {
+        return figure == Figure::NOTHING || (figure >= Figure::KNIGHT && figure <= Figure::QUEEN);
+    }
+
+    bool ParsePromotion(std::string_view token, Figure& figure) {
+        if (token.size() != 1) {
+            return false;
+        }
+        size_t index = FIGURE_LETTERS.find(ToUpper(token[0]));
+        if (index == std::string_view::npos || !IsPromotion(static_cast<Figure>(index))) {
+            return false;
+        }
+        figure = static_cast<Figure>(index);
+        return true;
+    }
+
+    uint32_t LoadU32(const char* data) {
+        auto bytes = reinterpret_cast<const unsigned char*>(data);
+        return static_cast<uint32_t>(bytes[0]) | static_cast<uint32_t>(bytes[1]) << 8 |
+               static_cast<uint32_t>(bytes[2]) << 16 | static_cast<uint32_t>(bytes[3]) << 24;
+    }
+
+    uint64_t LoadU64(const char* data) {
+        return static_cast<uint64_t>(LoadU32(data)) | static_cast<uint64_t>(LoadU32(data + 4)) << 32;
+    }
+
+}
+
+
+const char* CommandName(Command command) {
+    return COMMAND_NAMES[std::min(static_cast<size_t>(command), COMMAND_COUNT)];
+}
+
+
+bool ParseTextRequest(std::string_view message, Request& request) {
+    request = Request();
+    std::string_view rest = message;
+    std::string_view group = NextToken(rest);
+    if (IEquals(group, "BATCH")) {
+        request.command = Command::BATCH;
+        request.batch = rest;
+        return true;
+    }
+    std::string_view name = NextToken(rest);
+
+    size_t code = 0;
+    while (code < COMMAND_COUNT &&
+           !(IEquals(group, COMMANDS[code].group) &&
+             (COMMANDS[code].arguments == Arguments::PROTOCOL || IEquals(name, COMMANDS[code].name)))) {
+        ++code;
+    }
+    if (code == COMMAND_COUNT) {
+        return false;
+    }
+    request.command = static_cast<Command>(code);
+
+    switch (COMMANDS[code].arguments) {
+        case Arguments::NONE:
+            return true;
+        case Arguments::ID:
+            return request.has_id = ParseNumber(NextToken(rest), request.id);
+        case Arguments::OPTIONAL_ID: {
+            std::string_view token = NextToken(rest);
+            if (token.empty()) {
+                return true;
+            }
+            return request.has_id = ParseNumber(token, request.id);
+        }
+        case Arguments::ID_VERSION: {
+            if (!(request.has_id = ParseNumber(NextToken(rest), request.id))) {
+                return false;
+            }
+            std::string_view token = NextToken(rest);
+            if (token.empty()) {
+                return true;
+            }
+            return request.has_version = ParseNumber(token, request.version);
+        }
+        case Arguments::MOVE:
+            // GAME MOVE <game_id> <откуда> <куда> <превращение или "-">
+            return (request.has_id = ParseNumber(NextToken(rest), request.id)) &&
+                   ParseSquare(NextToken(rest), request.move.from) &&
+                   ParseSquare(NextToken(rest), request.move.to) &&
+                   ParsePromotion(NextToken(rest), request.move.promotion);
+        case Arguments::NICKNAME:
+            request.nickname = NextToken(rest);
+            return IsNickname(request.nickname);
+        case Arguments::PROTOCOL:
+            request.has_id = true;
+            if (IEquals(name, "TEXT")) {
+                request.id = 0;
+                return true;
+            }
+            request.id = 1;
+            return IEquals(name, "BINARY");
+        case Arguments::LOG_LEVEL: {
+            // ADMIN LOG [уровень] - без уровня только сообщает текущий
+            std::string_view token = NextToken(rest);
+            if (token.empty()) {
+                return true;
+            }
+            for (size_t i = 0; i < std::size(LOG_LEVELS); ++i) {
+                if (IEquals(token, LOG_LEVELS[i])) {
+                    request.id = static_cast<uint32_t>(i);
+                    request.has_id = true;
+                    return true;
+                }
+            }
+            return false;
+        }
+        case Arguments::BATCH:
+            break;
+    }
+    return false;
+}
+
+
+bool ParseBinaryRequest(std::string_view message, Request& request) {
+    request = Request();
+    if (message.empty() || static_cast<uint8_t>(message[0]) >= COMMAND_COUNT) {
+        return false;
+    }
+    size_t code = static_cast<uint8_t>(message[0]);
+    request.command = static_cast<Command>(code);
+    request.binary = true;
+    std::string_view body = message.substr(1);
+
+    switch (COMMANDS[code].arguments) {
+        case Arguments::NONE:
+            return body.empty();
+        case Arguments::ID:
+        case Arguments::OPTIONAL_ID:
+        case Arguments::ID_VERSION:
+            if (body.empty() && COMMANDS[code].arguments == Arguments::OPTIONAL_ID) {
+                return true;
+            }
+            if (body.size() == 12 && COMMANDS[code].arguments == Arguments::ID_VERSION) {
+                request.version = LoadU64(body.data() + 4);
+                request.has_version = true;
+            } else if (body.size() != 4) {
+                return false;
+            }
+            request.id = LoadU32(body.data());
+            request.has_id = true;
+            return true;
+        case Arguments::MOVE: {
+            if (body.size() != 6) {
+                return false;
+            }
+            request.id = LoadU32(body.data());
+            request.has_id = true;
+            auto bytes = reinterpret_cast<const unsigned char*>(body.data() + 4);
+            unsigned int move = bytes[0] | bytes[1] << 8;
+            unsigned int promotion = (move >> 12) & 7;
+            if (move >> 15 || !IsPromotion(static_cast<Figure>(promotion))) {
+                return false;
+            }
+            request.move = {static_cast<uint8_t>(move & 63), static_cast<uint8_t>((move >> 6) & 63),
+                            static_cast<Figure>(promotion)};
+            return true;
+        }
+        case Arguments::NICKNAME:
+            if (!IsNickname(body)) {
+                return false;
+            }
+            request.nickname = body;
+            return true;
+        case Arguments::PROTOCOL:
+            if (body.size() != 1 || static_cast<uint8_t>(body[0]) > 1) {
+                return false;
+            }
+            request.id = static_cast<uint8_t>(body[0]);
+            request.has_id = true;
+            return true;
+        case Arguments::LOG_LEVEL:
+            if (body.empty()) {
+                return true;
+            }
+            if (body.size() != 1 || static_cast<uint8_t>(body[0]) >= std::size(LOG_LEVELS)) {
+                return false;
+            }
+            request.id = static_cast<uint8_t>(body[0]);
+            request.has_id = true;
+            return true;
+        case Arguments::BATCH:
+            request.batch = body;
+            return true;
+    }
+    return false;
+}
+
+
+bool ParseBatch(const Request& batch, BatchRequests& requests) {
+    requests.Clear();
+    std::string_view rest = batch.batch;
+    while (!rest.empty()) {
+        std::string_view message;
+        if (batch.binary) {
+            size_t size = static_cast<uint8_t>(rest[0]);
+            if (size + 1 > rest.size()) {
+                return false;
+            }
+            message = rest.substr(1, size);
+            rest.remove_prefix(size + 1);
+        } else {
+            size_t end = std::min(rest.find('\n'), rest.size());
+            message = rest.substr(0, end);
+            rest.remove_prefix(std::min(end + 1, rest.size()));
+            std::string_view line = message;
+            if (NextToken(line).empty()) {
+                // пустая строка, например сразу после "BATCH"
+                continue;
+            }
+        }
+
+        if (requests.Size() == MAX_BATCH) {
+            return false;
+        }
+        Request request;
+        bool parsed = batch.binary ? ParseBinaryRequest(message, request) : ParseTextRequest(message, request);
+        if (!parsed || request.command == Command::PROTOCOL || request.command == Command::BATCH) {
+            request.command = Command::COUNT;
+        }
+        requests.Add(request);
+    }
+    return true;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "engine/MoveList.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * Команды протокола. Значение - код команды в двоичном формате.
+ */
+enum class Command : uint8_t {
+    GET_LOBBIES,
+    GET_BOTSTATS,
+    LOBBY_ENTER,
+    LOBBY_CREATE,
+    LOBBY_BOT,
+    LOBBY_REFRESH,
+    LOBBY_DELETE,
+    LOBBY_SUBSCRIBE,
+    LOBBY_UNSUBSCRIBE,
+    GAME_BOARD,
+    GAME_DELTA,
+    GAME_MOVE,
+    GAME_TAKEBACK,
+    GAME_RESULT,
+    GAME_TURN,
+    GAME_SUBSCRIBE,
+    GAME_UNSUBSCRIBE,
+    PROTOCOL,
+    BATCH,
+    ADMIN_LOG,
+    GAME_ACCEPT,
+    COUNT
+};
+
+constexpr size_t COMMAND_COUNT = static_cast<size_t>(Command::COUNT);
+
+// Имя команды, как в перечислении ("GAME_MOVE"); для Command::COUNT - "INVALID"
+const char* CommandName(Command command);
+
+/**
+ * Разобранный запрос в любом из форматов. Строки указывают внутрь принятого сообщения
+ * и действительны, пока сообщение не освобождено.
+ */
+struct Request {
+    Command command = Command::COUNT;
+    // Номер лобби или game_id; для LOBBY BOT - время на ход бота, мс; для PROTOCOL - 1, если двоичный;
+    // для ADMIN LOG - уровень журнала (LogLevel)
+    uint32_t id = 0;
+    bool has_id = false;
+    // GAME DELTA - версия доски, уже полученная клиентом
+    uint64_t version = 0;
+    bool has_version = false;
+    // GAME MOVE - клетки проверены, превращение Figure::NOTHING, если не указано
+    Move move{};
+    // LOBBY CREATE
+    std::string_view nickname;
+    // BATCH - запросы пакета, еще не разобранные (см. ParseBatch)
+    std::string_view batch;
+    // Запрос пришел в двоичном формате
+    bool binary = false;
+};
+
+// Запросов в одном BATCH не больше
+constexpr size_t MAX_BATCH = 32;
+
+using BatchRequests = FixedList<Request, MAX_BATCH>;
+
+// Ник длиннее не принимается
+constexpr size_t MAX_NICKNAME = 32;
+
+/**
+ * Текстовый формат: "<группа> <команда> <аргументы...>" через пробелы, без учета регистра,
+ * например "GAME MOVE 3 E7 E5 -", "PROTOCOL BINARY". Лишние аргументы в конце игнорируются.
+ * Превращение в GAME MOVE - "-", N, B, R или Q.
+ * "BATCH" - пакет: следующие строки сообщения, по запросу на строку.
+ * @return false, если команда неизвестна или аргументы не разбираются
+ */
+bool ParseTextRequest(std::string_view message, Request& request);
+
+/**
+ * Двоичный формат (после "PROTOCOL BINARY"): байт кода команды и аргументы фиксированного
+ * размера, числа little-endian:
+ *  - без аргументов: GET_*, LOBBY_SUBSCRIBE, LOBBY_UNSUBSCRIBE;
+ *  - u32 id: LOBBY_ENTER, LOBBY_REFRESH, LOBBY_DELETE, GAME_* кроме DELTA и MOVE;
+ *  - LOBBY_BOT: [u32 время на ход, мс];  GAME_DELTA: u32 game_id [u64 версия];
+ *  - ADMIN_LOG: [u8 уровень: 0 DEBUG, 1 INFO, 2 WARNING, 3 ERROR, 4 OFF];
+ *  - GAME_MOVE: u32 game_id, u16 ход (биты 0-5 откуда, 6-11 куда, 12-14 превращение: 0 или Figure от KNIGHT до QUEEN,
+ *    клетка = ряд * 8 + колонка);
+ *  - LOBBY_CREATE: ник - остаток сообщения, от 1 до MAX_NICKNAME печатных символов без пробелов;
+ *  - PROTOCOL: u8 0 - текстовый, 1 - двоичный;
+ *  - BATCH: запросы пакета, перед каждым - u8 длина.
+ * Сообщение другой длины отвергается целиком.
+ */
+bool ParseBinaryRequest(std::string_view message, Request& request);
+
+/**
+ * Запросы пакета BATCH в том же формате, что и сам пакет. Запрос, который не разбирается,
+ * попадает в requests с командой Command::COUNT, на него отвечается "-"; вложенный BATCH и
+ * PROTOCOL в пакете тоже не выполняются.
+ * @return false, если запросов больше MAX_BATCH или нарушены длины двоичного пакета
+ */
+bool ParseBatch(const Request& batch, BatchRequests& requests);
@@ -1,241 +1,931 @@
 #include "Server.h"
+#include "Session.h"
+#include "Logger.h"
+#include "Metrics.h"
 
-#include <boost/algorithm/string.hpp>
+#include <boost/asio/post.hpp>
+#include <algorithm>
+#include <array>
+#include <initializer_list>
+#include <optional>
+#include <sstream>
 
 unsigned int MASK_OFF = 0xFFFFFFFE;
 
-void Server::DoSession(tcp::socket &socket) {
-    try {
-        // Construct the stream by moving in the socket
-        websocket::stream<tcp::socket> ws{std::move(socket)};
-
-        // Set a decorator to change the Server of the handshake
-        ws.set_option(websocket::stream_base::decorator(
-                [](websocket::response_type &res) {
-                    res.set(http::field::server,
-                            std::string(BOOST_BEAST_VERSION_STRING) +
-                            " websocket-server-sync");
-                }));
+namespace {
 
-        // Accept the websocket handshake
-        ws.accept();
-
-        for (;;) {
-            // This buffer will hold the incoming message
-            beast::flat_buffer buffer;
+    // Цвет игрока по game_id: младший бит - черные
+    Color PlayerColor(unsigned int game_id) {
+        return game_id & 1 ? Color::BLACK : Color::WHITE;
+    }
 
-            // Read a message
-            ws.read(buffer);
-            // Echo the message back
-            ws.text(ws.got_text());
+    // Код результата партии, как в ответе GAME RESULT
+    const char* ResultCode(Result result) {
+        switch (result) {
+            case Result::IN_PROGRESS:
+                return "0";
+            case Result::DRAW:
+                return "1";
+            case Result::WHITE_WIN:
+                return "2";
+            case Result::BLACK_WIN:
+                return "3";
+        }
+        return "-";
+    }
 
-            auto response = HandleRequest(beast::buffers_to_string(buffer.data()));
-            ws.write(net::buffer(std::move(response)));
+    // Срок из переменной окружения в секундах, fallback - если она не задана или не число
+    std::chrono::seconds EnvSeconds(const char* name, std::chrono::seconds fallback) {
+        const char* value = std::getenv(name);
+        if (value == nullptr) {
+            return fallback;
         }
-    } catch (beast::system_error const &se) {
-        // This indicates that the session was closed
-        if (se.code() != websocket::error::closed)
-            std::cerr << "Error: " << se.code().message() << std::endl;
-    } catch (std::exception const &e) {
-        std::cerr << "Error: " << e.what() << std::endl;
+        char* end = nullptr;
+        long seconds = std::strtol(value, &end, 10);
+        return end != value && *end == '\0' && seconds > 0 ? std::chrono::seconds(seconds) : fallback;
     }
+
+    LogRecord MakeRecord(LogRecordType type, unsigned int lobby_id, uint32_t value = 0) {
+        LogRecord record;
+        record.type = type;
+        record.lobby_id = lobby_id;
+        record.value = value;
+        return record;
+    }
+
 }
 
-void Server::Run(int argc, char *argv[]) {
+int Server::Run(int argc, char *argv[]) {
     try {
         // Check command line arguments.
-        if (argc != 3) {
+        if (argc < 3 || argc > 5) {
             std::cerr <<
-                      "Usage: websocket-server-sync <address> <port>\n" <<
+                      "Usage: websocket-server-async <address> <port> [bot_threads] [io_threads]\n" <<
                       "Example:\n" <<
-                      "    websocket-server-sync 0.0.0.0 8080\n";
-            return;
+                      "    websocket-server-async 0.0.0.0 8080 2 4\n";
+            return EXIT_FAILURE;
         }
         auto const address = net::ip::make_address(argv[1]);
         auto const port = static_cast<unsigned short>(std::atoi(argv[2]));
+        if (argc >= 4) {
+            bot_threads = static_cast<unsigned int>(std::max(1, std::atoi(argv[3])));
+        }
+        if (argc >= 5) {
+            io_threads = static_cast<unsigned int>(std::max(1, std::atoi(argv[4])));
+        }
+
+        finished_ttl = EnvSeconds("FOG_CHESS_FINISHED_TTL", finished_ttl);
+        abandon_timeout = EnvSeconds("FOG_CHESS_ABANDON_TIMEOUT", abandon_timeout);
+        idle_timeout = EnvSeconds("FOG_CHESS_IDLE_TIMEOUT", idle_timeout);
+        if (const char* path = std::getenv("FOG_CHESS_ARCHIVE")) {
+            archive = std::fopen(path, "a");
+            if (archive == nullptr) {
+                Log(LogLevel::ERROR, "Cannot open game archive ", path);
+            }
+        }
+
+        if (const char* path = std::getenv("FOG_CHESS_WAL")) {
+            // Без журнала сервер потерял бы все ходы при перезапуске - лучше не запускаться
+            if (!move_log.Open(path, [this](const LogRecord& record) {
+                Replay(record);
+            })) {
+                Log(LogLevel::ERROR, "Cannot open move log ", path, ", exiting");
+                Logger::Instance().Flush();
+                return EXIT_FAILURE;
+            }
+            games.ForEach([this](unsigned int lobby_id, const std::shared_ptr<GameEntry>& entry) {
+                entry->game.UpdateStatus();
+                Chessboard& chessboard = entry->game.GetChessboard();
+                if (entry->bot.has_value() && chessboard.GetCurrentTurn() == entry->bot->GetColor()) {
+                    ScheduleBotMove(lobby_id);
+                }
+            });
+            Log(LogLevel::INFO, "Restored ", std::to_string(games.Size()), " games and ",
+                std::to_string(lobbies.size()), " lobbies");
+        }
+
+        // Потоки ботов не занимают ядра, оставленные потокам ввода-вывода. Переборы разных партий
+        // идут параллельно в bot_workers потоках, у каждого перебора свои вспомогательные потоки
+        unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+        bot_threads = std::min(bot_threads, std::max(1u, cores > io_threads ? cores - io_threads : 1u));
+        bot_search_threads = std::min(bot_threads, BOT_SEARCH_THREADS);
+        unsigned int bot_workers = std::max(1u, bot_threads / bot_search_threads);
+        for (unsigned int i = 0; i < bot_workers; ++i) {
+            std::thread{[this]() {
+                this->BotLoop();
+            }}.detach();
+        }
+        std::thread{[this]() {
+            this->ReaperLoop();
+        }}.detach();
 
         // The io_context is required for all I/O
-        net::io_context ioc{1};
+        net::io_context ioc{static_cast<int>(io_threads)};
+
+        game_strands.reserve(GAME_STRANDS);
+        for (size_t i = 0; i < GAME_STRANDS; ++i) {
+            game_strands.emplace_back(net::make_strand(ioc));
+        }
 
-        // The acceptor receives incoming connections
-        tcp::acceptor acceptor{ioc, {address, port}};
-        for (;;) {
-            // This will receive the new connection
-            tcp::socket socket{ioc};
+        std::make_shared<Listener>(ioc, tcp::endpoint{address, port}, *this)->Run();
 
-            // Block until we get a connection
-            acceptor.accept(socket);
+        // Соединения обслуживает пул из io_threads потоков, включая текущий
+        std::vector<std::thread> pool;
+        pool.reserve(io_threads - 1);
+        for (unsigned int i = 1; i < io_threads; ++i) {
+            pool.emplace_back([&ioc]() {
+                ioc.run();
+            });
+        }
+        ioc.run();
 
-            // Launch the session, transferring ownership of the socket
-            std::thread{std::bind(
-                    [this](tcp::socket &socket) {
-                        this->DoSession(socket);
-                    },
-                    std::move(socket))}.detach();
+        for (std::thread& thread : pool) {
+            thread.join();
         }
     } catch (const std::exception &e) {
-        std::cerr << "Error: " << e.what() << std::endl;
-        return;
+        Log(LogLevel::ERROR, "Server error: ", e.what());
+        Logger::Instance().Flush();
+        return EXIT_FAILURE;
     }
+    Logger::Instance().Flush();
+    return EXIT_SUCCESS;
+}
+
+Server::strand& Server::GameStrand(unsigned int lobby_id) {
+    return game_strands[(lobby_id / 2) % game_strands.size()];
 }
 
+void Server::Dispatch(const std::shared_ptr<Session>& session, const Request& request) {
+    // Пакет разбирается здесь, чтобы выполнить его на strand первой партии в нем
+    std::unique_ptr<BatchRequests> batch;
+    std::optional<unsigned int> lobby_id;
+    if (request.command == Command::BATCH) {
+        batch = std::make_unique<BatchRequests>();
+        if (!ParseBatch(request, *batch)) {
+            session->Respond("-");
+            return;
+        }
+        for (const Request& item : *batch) {
+            if (IsGameCommand(item.command)) {
+                lobby_id = item.id & MASK_OFF;
+                break;
+            }
+        }
+    } else if (IsGameCommand(request.command)) {
+        lobby_id = request.id & MASK_OFF;
+    }
 
-std::map<char, ColoredFigure> char_to_figure_2 = {
-        {'P', {Color::WHITE, Figure::PAWN}},
-        {'N', {Color::WHITE, Figure::KNIGHT}},
-        {'B', {Color::WHITE, Figure::BISHOP}},
-        {'R', {Color::WHITE, Figure::ROOK}},
-        {'Q', {Color::WHITE, Figure::QUEEN}},
-        {'K', {Color::WHITE, Figure::KING}},
-        {'p', {Color::BLACK, Figure::PAWN}},
-        {'n', {Color::BLACK, Figure::KNIGHT}},
-        {'b', {Color::BLACK, Figure::BISHOP}},
-        {'r', {Color::BLACK, Figure::ROOK}},
-        {'q', {Color::BLACK, Figure::QUEEN}},
-        {'k', {Color::BLACK, Figure::KING}},
-};
+    auto handle = [this, session, request, batch = std::move(batch), started = std::chrono::steady_clock::now()]() {
+        uint64_t logged = MoveLog::ThreadSequence();
+        std::string response;
+        try {
+            response = batch != nullptr ? HandleBatch(*batch, request.binary, session) : HandleRequest(request, session);
+        } catch (const std::exception &e) {
+            Log(LogLevel::ERROR, "Request error: ", e.what());
+            response = "-";
+        }
+        Metrics::Instance().RecordRequest(request.command, std::chrono::steady_clock::now() - started, response == "-");
+
+        uint64_t sequence = MoveLog::ThreadSequence();
+        if (sequence != logged) {
+            // Запрос изменил состояние - ответ уходит, когда изменения записаны на диск;
+            // если записать их не удалось, игрок получает "-"
+            move_log.AfterCommit(sequence, [session, response = std::move(response)](bool durable) mutable {
+                session->Respond(durable ? std::move(response) : std::string("-"));
+            });
+        } else {
+            session->Respond(std::move(response));
+        }
+    };
 
-std::string Server::HandleRequest(const std::string &request) {
-    std::cout << request << std::endl;
+    if (lobby_id.has_value()) {
+        net::post(GameStrand(*lobby_id), std::move(handle));
+    } else {
+        handle();
+    }
+}
 
-    std::istringstream stream(request);
-    std::string method;
-    stream >> method;
 
-    if (boost::iequals(method, "GET")) {
-        std::string what;
-        stream >> what;
+void Server::Checkpoint() {
+    move_log.BeginCheckpoint();
+    {
+        std::lock_guard guard(id_mutex);
+        move_log.Append(MakeRecord(LogRecordType::NEXT_ID, 0, id));
+    }
+    {
+        std::lock_guard<std::mutex> guard(lobbies_mutex);
+        for (const auto& [lobby_id, nickname] : lobbies) {
+            LogRecord record = MakeRecord(LogRecordType::LOBBY_CREATE, lobby_id);
+            record.nickname = nickname;
+            move_log.Append(record);
+        }
+    }
+    games.ForEach([this](unsigned int lobby_id, const std::shared_ptr<GameEntry>& entry) {
+        std::lock_guard<std::mutex> guard(entry->mutex);
+        uint32_t budget_ms = entry->bot.has_value() ? static_cast<uint32_t>(entry->bot->GetBudget().count()) : 0;
+        LogRecord record = MakeRecord(LogRecordType::GAME, lobby_id, budget_ms);
+        PackedPosition start;
+        entry->game.GetChessboard().GetSnapshot(start, record.moves);
+        record.position = start;
+        move_log.Append(record);
+    });
+    move_log.EndCheckpoint();
+    Log(LogLevel::INFO, "Move log checkpoint written");
+}
 
-        // GET LOBBIES
-        if (boost::iequals(what, "LOBBIES")) {
-            std::lock_guard<std::mutex> guard(lobbies_mutex);
-            std::ostringstream output;
+void Server::Replay(const LogRecord& record) {
+    unsigned int lobby_id = record.lobby_id;
+    if (record.type != LogRecordType::NEXT_ID && record.type != LogRecordType::CHECKPOINT) {
+        id = std::max(id, lobby_id + 2);
+    }
 
-            for (auto&[game_id, player] : lobbies) {
-                output << game_id << " " << player << " ";
+    switch (record.type) {
+        case LogRecordType::NEXT_ID:
+            id = std::max(id, record.value);
+            break;
+        case LogRecordType::LOBBY_CREATE:
+            lobbies[lobby_id] = std::string(record.nickname);
+            break;
+        case LogRecordType::LOBBY_DELETE:
+            lobbies.erase(lobby_id);
+            break;
+        case LogRecordType::LOBBY_ENTER:
+        case LogRecordType::BOT_GAME:
+        case LogRecordType::GAME: {
+            lobbies.erase(lobby_id);
+            games.Erase(lobby_id);
+            std::optional<Bot> bot;
+            if (record.type != LogRecordType::LOBBY_ENTER && record.value != 0) {
+                bot.emplace(Color::BLACK, std::chrono::milliseconds(record.value));
+            }
+            std::shared_ptr<GameEntry> entry = games.Emplace(lobby_id, Game(lobby_id, lobby_id + 1), std::move(bot));
+            if (record.position.has_value() && !entry->game.GetChessboard().Unpack(*record.position)) {
+                Log(LogLevel::WARNING, "Move log: bad position in game ", std::to_string(lobby_id));
+                games.Erase(lobby_id);
+                break;
+            }
+            for (const Move& move : record.moves) {
+                if (!entry->game.GetChessboard().MakeMove(move)) {
+                    Log(LogLevel::WARNING, "Move log: illegal move in game ", std::to_string(lobby_id));
+                    break;
+                }
+            }
+            break;
+        }
+        case LogRecordType::MOVE:
+        case LogRecordType::TAKEBACK: {
+            // Ходы партии, снимок которой еще впереди, пропускаются: снимок их уже содержит
+            std::shared_ptr<GameEntry> entry = games.Find(lobby_id);
+            if (entry == nullptr) {
+                break;
+            }
+            Chessboard& chessboard = entry->game.GetChessboard();
+            bool applied = record.type == LogRecordType::MOVE ? chessboard.MakeMove(record.move) : chessboard.UnmakeMove();
+            if (!applied) {
+                Log(LogLevel::WARNING, "Move log: cannot replay move in game ", std::to_string(lobby_id));
             }
+            break;
+        }
+        case LogRecordType::EVICT:
+            games.Erase(lobby_id);
+            break;
+        case LogRecordType::CHECKPOINT:
+            break;
+    }
+}
 
-            return output.str();
+std::string Server::MetricsText() {
+    std::string output;
+    Metrics::Instance().WritePrometheus(output);
+
+    size_t lobby_count;
+    {
+        std::lock_guard<std::mutex> guard(lobbies_mutex);
+        lobby_count = lobbies.size();
+    }
+    SearchStats stats = searcher.GetStats();
+    Logger& logger = Logger::Instance();
+    output += "# HELP fog_chess_games Games in the registry.\n# TYPE fog_chess_games gauge\n"
+              "fog_chess_games " + std::to_string(games.Size()) + "\n"
+              "# HELP fog_chess_games_evicted_total Finished or abandoned games removed from the registry.\n"
+              "# TYPE fog_chess_games_evicted_total counter\n"
+              "fog_chess_games_evicted_total " + std::to_string(games_evicted.load(std::memory_order_relaxed)) + "\n"
+              "# HELP fog_chess_lobbies Open lobbies waiting for a second player.\n# TYPE fog_chess_lobbies gauge\n"
+              "fog_chess_lobbies " + std::to_string(lobby_count) + "\n"
+              "# HELP fog_chess_bot_searches_total Bot searches.\n# TYPE fog_chess_bot_searches_total counter\n"
+              "fog_chess_bot_searches_total " + std::to_string(stats.searches) + "\n"
+              "# HELP fog_chess_bot_nodes_total Nodes searched by bots.\n# TYPE fog_chess_bot_nodes_total counter\n"
+              "fog_chess_bot_nodes_total " + std::to_string(stats.nodes) + "\n"
+              "# HELP fog_chess_log_records_total Log records written.\n# TYPE fog_chess_log_records_total counter\n"
+              "fog_chess_log_records_total " + std::to_string(logger.Written()) + "\n"
+              "# HELP fog_chess_log_dropped_total Log records dropped on a full ring.\n"
+              "# TYPE fog_chess_log_dropped_total counter\n"
+              "fog_chess_log_dropped_total " + std::to_string(logger.Dropped()) + "\n"
+              "# HELP fog_chess_move_log_failed 1 if the move log failed to write and changes are rejected.\n"
+              "# TYPE fog_chess_move_log_failed gauge\n"
+              "fog_chess_move_log_failed " + std::string(move_log.IsFailed() ? "1" : "0") + "\n";
+    return output;
+}
+
+
+void Server::BotLoop() {
+    for (;;) {
+        unsigned int lobby_id;
+        {
+            std::unique_lock<std::mutex> lock(bot_queue_mutex);
+            bot_queue_cv.wait(lock, [this]() { return !bot_queue.empty(); });
+            lobby_id = bot_queue.front();
+            bot_queue.pop_front();
         }
 
+        try {
+            PlayBotMove(lobby_id);
+        } catch (const std::exception &e) {
+            Log(LogLevel::ERROR, "Bot error: ", e.what());
+        }
+    }
+}
 
-        return "-";
-    } else if (boost::iequals(method, "LOBBY")) {
-        std::string what;
-        stream >> what;
+void Server::ScheduleBotMove(unsigned int lobby_id) {
+    {
+        std::lock_guard<std::mutex> guard(bot_queue_mutex);
+        bot_queue.push_back(lobby_id);
+    }
+    bot_queue_cv.notify_one();
+}
+
+void Server::PlayBotMove(unsigned int lobby_id) {
+    std::shared_ptr<GameEntry> entry = games.Find(lobby_id);
+    if (entry == nullptr || !entry->bot.has_value()) {
+        return;
+    }
 
-        if (boost::iequals(what, "ENTER")) {
-            std::lock_guard<std::mutex> guard(lobbies_mutex);
-            unsigned int lobby_id; stream >> lobby_id;
-            auto it = lobbies.find(lobby_id);
-            if (it != lobbies.end()) {
-                lobbies.erase(lobby_id);
-            } else {
-                return "-";
+    // Позиция для перебора строится только по тому, что бот видит сквозь "туман войны"
+    std::optional<Chessboard> position;
+    SearchLimits limits;
+    limits.threads = static_cast<int>(bot_search_threads);
+    Color color;
+    uint64_t version;
+    {
+        std::lock_guard<std::mutex> guard(entry->mutex);
+        Chessboard& chessboard = entry->game.GetChessboard();
+        color = entry->bot->GetColor();
+        if (chessboard.GetCurrentTurn() != color || chessboard.Result() != Result::IN_PROGRESS ||
+            entry->game.GetStatus() == GameStatus::ABANDONED || entry->evicted || move_log.IsFailed()) {
+            return;
+        }
+        version = chessboard.GetVersion();
+        limits.budget = entry->bot->GetBudget();
+        position = entry->bot->GuessPosition(Timed(EngineOperation::FOW_FEN, [&]() { return chessboard.GetFOWFen(color); }));
+    }
+
+    SearchResult result;
+    if (position.has_value()) {
+        result = searcher.Search(*position, limits);
+    }
+
+    std::lock_guard<std::mutex> guard(entry->mutex);
+    Chessboard& chessboard = entry->game.GetChessboard();
+    if (chessboard.GetVersion() != version || entry->evicted || move_log.IsFailed()) {
+        // Пока бот думал, игрок отменил ход, партия удалена или журнал перестал принимать изменения
+        return;
+    }
+
+    // Лучший ход по догадке может оказаться невозможным из-за невидимых фигур - пробуем следующие
+    bool success = false;
+    Move played{};
+    for (const Move& move : result.ranked) {
+        if (Timed(EngineOperation::MAKE_MOVE, [&]() { return chessboard.MakeMove(move); })) {
+            success = true;
+            played = move;
+            break;
+        }
+    }
+
+    if (!success) {
+        MoveList moves;
+        chessboard.AllPossibleMoves(color, moves);
+        success = !moves.Empty() && Timed(EngineOperation::MAKE_MOVE, [&]() { return chessboard.MakeMove(moves[0]); });
+        if (success) {
+            played = moves[0];
+        }
+    }
+
+    if (success) {
+        LogRecord record = MakeRecord(LogRecordType::MOVE, lobby_id);
+        record.move = played;
+        move_log.Append(record);
+        entry->game.UpdateStatus();
+        PublishGame(lobby_id, *entry);
+    }
+}
+
+void Server::ReaperLoop() {
+    for (;;) {
+        std::this_thread::sleep_for(REAP_INTERVAL);
+        try {
+            ReapGames();
+            // Контрольная точка в том же потоке: удаление партии не попадает в середину ее снимка
+            auto [growth, checkpoint_size] = move_log.GetGrowth();
+            if (move_log.IsOpen() && !move_log.IsFailed() && growth > std::max(CHECKPOINT_BYTES, checkpoint_size)) {
+                Checkpoint();
+            }
+        } catch (const std::exception &e) {
+            Log(LogLevel::ERROR, "Reaper error: ", e.what());
+        }
+    }
+}
+
+void Server::ReapGames() {
+    auto now = std::chrono::steady_clock::now();
+    std::string archived;
+    games.ForEach([&](unsigned int lobby_id, const std::shared_ptr<GameEntry>& entry) {
+        {
+            std::lock_guard<std::mutex> guard(entry->mutex);
+            Game& game = entry->game;
+            auto& subscribers = entry->subscribers;
+            subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(), [](const auto& subscriber) {
+                return subscriber.first.expired();
+            }), subscribers.end());
+
+            bool finished = game.GetStatus() == GameStatus::FINISHED && now - game.GetLastChange() > finished_ttl;
+            bool abandoned = game.GetStatus() == GameStatus::ABANDONED ||
+                             (subscribers.empty() && now - game.GetLastActivity() > abandon_timeout) ||
+                             now - game.GetLastChange() > idle_timeout;
+            if (!finished && !abandoned) {
+                return;
             }
-            games.emplace(lobby_id, Game(lobby_id, lobby_id + 1));
-            std::ostringstream output;
-            return std::to_string(lobby_id + 1);
-        } else if (boost::iequals(what, "CREATE")) {
-            std::lock_guard<std::mutex> guard(lobbies_mutex);
-            unsigned int lobby_id = id;
-            {
-                std::lock_guard guard(id_mutex);
-                id += 2;
+            if (game.GetStatus() != GameStatus::FINISHED) {
+                game.Abandon();
             }
-            std::string nickname; stream >> nickname;
-            lobbies.emplace(lobby_id, nickname);
-            return std::to_string(lobby_id);
-        } else if (boost::iequals(what, "REFRESH")) {
-            unsigned int lobby_id; stream >> lobby_id;
-            if (lobbies.count(lobby_id)) {
-                return "-";
+            // Запросы, уже получившие запись, не попадут в журнал после EVICT
+            entry->evicted = true;
+            move_log.Append(MakeRecord(LogRecordType::EVICT, lobby_id));
+
+            if (archive != nullptr) {
+                Chessboard& chessboard = game.GetChessboard();
+                archived += std::to_string(lobby_id) + " " + GameStatusName(game.GetStatus()) + " " +
+                            ResultCode(chessboard.Result()) + " " + std::to_string(chessboard.GetVersion()) + " " +
+                            chessboard.GetFen() + "\n";
             }
+            Log(LogLevel::DEBUG, "Game ", std::to_string(lobby_id), " evicted: ", GameStatusName(game.GetStatus()));
+        }
+        if (games.Erase(lobby_id)) {
+            games_evicted.fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    if (archive != nullptr && !archived.empty()) {
+        std::fwrite(archived.data(), 1, archived.size(), archive);
+        std::fflush(archive);
+    }
+}
 
-            return std::to_string(lobby_id);
-        } else if (boost::iequals(what, "DELETE")) {
-            unsigned int lobby_id; stream >> lobby_id;
-            if (lobbies.count(lobby_id))
-                lobbies.erase(lobby_id);
+void Server::PublishGame(unsigned int lobby_id, GameEntry& entry) {
+    if (entry.subscribers.empty()) {
+        return;
+    }
 
-            return "";
+    // Кадры всех нужных цветов кодируются одним пакетом по упакованной позиции, каждый - один раз
+    Chessboard& chessboard = entry.game.GetChessboard();
+    std::array<bool, 2> wanted{};
+    for (const auto& subscriber : entry.subscribers) {
+        wanted[static_cast<int>(subscriber.second)] = true;
+    }
+    std::array<PackedPosition, 2> positions;
+    std::array<Bitboard, 2> visible;
+    std::array<FogFrame, 2> frames;
+    std::array<Color, 2> colors;
+    size_t count = 0;
+    PackedPosition packed = chessboard.Pack();
+    for (Color color : {Color::WHITE, Color::BLACK}) {
+        if (wanted[static_cast<int>(color)]) {
+            positions[count] = packed;
+            visible[count] = chessboard.VisibleFields(color);
+            colors[count++] = color;
         }
+    }
+    Timed(EngineOperation::FOW_FEN, [&]() {
+        EncodeFogFrames(positions.data(), visible.data(), frames.data(), count);
+    });
+
+    std::string prefix = std::to_string(chessboard.GetVersion()) + " " + ResultCode(chessboard.Result()) + " ";
+    std::string tail = " " + chessboard.GetFOWTail();
+    std::array<std::string, 2> events;
+    for (size_t i = 0; i < count; ++i) {
+        unsigned int game_id = lobby_id | (colors[i] == Color::BLACK ? 1 : 0);
+        std::string& event = events[static_cast<int>(colors[i])];
+        event = "EVENT GAME " + std::to_string(game_id) + " " + prefix;
+        event.append(frames[i].data(), frames[i].size());
+        event += tail;
+    }
 
-    } else if (boost::iequals(method, "GAME")) {
-        std::string what;
-        stream >> what;
+    auto& subscribers = entry.subscribers;
+    subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(), [&](const auto& subscriber) {
+        std::shared_ptr<Session> session = subscriber.first.lock();
+        if (session == nullptr) {
+            return true;
+        }
+        session->Send(events[static_cast<int>(subscriber.second)]);
+        return false;
+    }), subscribers.end());
+}
 
-        if (boost::iequals(what, "BOARD")) {
-            unsigned int game_id; stream >> game_id;
-            unsigned int lobby_id = game_id & MASK_OFF;
-            if (!games.count(lobby_id)) {
-                return "-";
-            }
+void Server::PublishLobby(const std::string& event) {
+    lobby_subscribers.erase(std::remove_if(lobby_subscribers.begin(), lobby_subscribers.end(),
+                                           [&](const std::weak_ptr<Session>& subscriber) {
+        std::shared_ptr<Session> session = subscriber.lock();
+        if (session == nullptr) {
+            return true;
+        }
+        session->Send(event);
+        return false;
+    }), lobby_subscribers.end());
+}
 
-            Game& game = games.at(lobby_id);
-            Color player_color = (game_id & 1 ? Color::BLACK : Color::WHITE);
 
-            return game.GetChessboard().GetFOWFen(player_color);
-        } else if (boost::iequals(what, "MOVE")) {
-            unsigned int game_id; stream >> game_id;
-            unsigned int lobby_id = game_id & MASK_OFF;
-            if (!games.count(lobby_id)) {
-                return "-";
-            }
+const std::array<Server::CommandHandler, COMMAND_COUNT> Server::HANDLERS = [] {
+    std::array<CommandHandler, COMMAND_COUNT> handlers{};
+    auto set = [&](Command command, Handler handler) {
+        handlers[static_cast<size_t>(command)].handler = handler;
+    };
+    auto set_game = [&](Command command, GameHandler handler) {
+        handlers[static_cast<size_t>(command)].game_handler = handler;
+    };
+    auto set_mutates = [&](std::initializer_list<Command> commands) {
+        for (Command command : commands) {
+            handlers[static_cast<size_t>(command)].mutates = true;
+        }
+    };
+
+    set(Command::GET_LOBBIES, &Server::GetLobbies);
+    set(Command::GET_BOTSTATS, &Server::GetBotStats);
+    set(Command::LOBBY_ENTER, &Server::LobbyEnter);
+    set(Command::LOBBY_CREATE, &Server::LobbyCreate);
+    set(Command::LOBBY_BOT, &Server::LobbyBot);
+    set(Command::LOBBY_REFRESH, &Server::LobbyRefresh);
+    set(Command::LOBBY_DELETE, &Server::LobbyDelete);
+    set(Command::LOBBY_SUBSCRIBE, &Server::LobbySubscribe);
+    set(Command::LOBBY_UNSUBSCRIBE, &Server::LobbySubscribe);
+    set(Command::ADMIN_LOG, &Server::AdminLog);
+    set_game(Command::GAME_BOARD, &Server::GameBoard);
+    set_game(Command::GAME_DELTA, &Server::GameDelta);
+    set_game(Command::GAME_MOVE, &Server::GameMove);
+    set_game(Command::GAME_TAKEBACK, &Server::GameTakeback);
+    set_game(Command::GAME_ACCEPT, &Server::GameAccept);
+    set_game(Command::GAME_RESULT, &Server::GameResult);
+    set_game(Command::GAME_TURN, &Server::GameTurn);
+    set_game(Command::GAME_SUBSCRIBE, &Server::GameSubscribe);
+    set_game(Command::GAME_UNSUBSCRIBE, &Server::GameSubscribe);
+    set_mutates({Command::LOBBY_ENTER, Command::LOBBY_CREATE, Command::LOBBY_BOT, Command::LOBBY_DELETE,
+                 Command::GAME_MOVE, Command::GAME_ACCEPT});
+    // PROTOCOL переключает формат соединения и обрабатывается в Session
+    return handlers;
+}();
+
+bool Server::IsGameCommand(Command command) {
+    return command < Command::COUNT && HANDLERS[static_cast<size_t>(command)].game_handler != nullptr;
+}
 
-            Game& game = games.at(lobby_id);
-            Color player_color = (game_id & 1 ? Color::BLACK : Color::WHITE);
-
-            // from to figure
-            std::string from, to, figure;
-            stream >> from >> to >> figure;
-
-            bool success;
-            if (figure == "-") {
-                success = game.GetChessboard().MakeMove(
-                        Coords(from[1] - '1', from[0] - 'A'),
-                        Coords(to[1] - '1', to[0] - 'A'));
-            } else {
-                if (!char_to_figure_2.count(figure[0])) {
-                    return "-";
-                }
-                Figure fig = char_to_figure_2.at(figure[0]).figure;
-                success = game.GetChessboard().MakeMove(
-                        Coords(from[1] - '1', from[0] - 'A'),
-                        Coords(to[1] - '1', to[0] - 'A'), fig);
-            }
+std::string Server::HandleRequest(std::string_view request, const std::shared_ptr<Session>& session) {
+    Request parsed;
+    if (!ParseTextRequest(request, parsed)) {
+        return "-";
+    }
+    return HandleRequest(parsed, session);
+}
 
-            return success ? "+" : "-";
-        } else if (boost::iequals(what, "RESULT")) {
-            unsigned int lobby_id; stream >> lobby_id;
-            lobby_id &= MASK_OFF;
-            if (!games.count(lobby_id)) {
-                return "-";
-            }
+std::string Server::HandleRequest(const Request& request, const std::shared_ptr<Session>& session) {
+    if (request.command == Command::BATCH) {
+        BatchRequests batch;
+        return ParseBatch(request, batch) ? HandleBatch(batch, request.binary, session) : "-";
+    }
+    if (request.command >= Command::COUNT) {
+        return "-";
+    }
+    const CommandHandler& handler = HANDLERS[static_cast<size_t>(request.command)];
+    if (handler.mutates && move_log.IsFailed()) {
+        return "-";
+    }
 
-            switch (games.at(lobby_id).GetChessboard().result_cache) {
-                case Result::IN_PROGRESS:
-                    return "0";
-                case Result::DRAW:
-                    return "1";
-                case Result::WHITE_WIN:
-                    return "2";
-                case Result::BLACK_WIN:
-                    return "3";
-            }
+    if (handler.game_handler != nullptr) {
+        // GAME <команда> <game_id> ... - для RESULT и TURN подходит и номер лобби
+        std::shared_ptr<GameEntry> entry = games.Find(request.id & MASK_OFF);
+        if (entry == nullptr) {
             return "-";
-        } else if (boost::iequals(what, "TURN")) {
-            unsigned int lobby_id; stream >> lobby_id;
-            lobby_id &= MASK_OFF;
-            if (!games.count(lobby_id)) {
-                return "-";
+        }
+        std::lock_guard<std::mutex> guard(entry->mutex);
+        if (entry->evicted) {
+            return "-";
+        }
+        entry->game.Touch();
+        return (this->*handler.game_handler)(request, *entry, session);
+    }
+    if (handler.handler != nullptr) {
+        return (this->*handler.handler)(request, session);
+    }
+    return "-";
+}
+
+std::string Server::HandleBatch(const BatchRequests& requests, bool binary, const std::shared_ptr<Session>& session) {
+    // Партии блокируются сразу все и по возрастанию номера: два пакета с общими партиями
+    // не могут ждать друг друга по кругу, а остальные запросы держат не больше одной партии
+    std::array<unsigned int, MAX_BATCH> lobby_ids;
+    size_t game_count = 0;
+    for (const Request& request : requests) {
+        if (IsGameCommand(request.command)) {
+            unsigned int lobby_id = request.id & MASK_OFF;
+            if (std::find(lobby_ids.begin(), lobby_ids.begin() + game_count, lobby_id) == lobby_ids.begin() + game_count) {
+                lobby_ids[game_count++] = lobby_id;
             }
+        }
+    }
+    std::sort(lobby_ids.begin(), lobby_ids.begin() + game_count);
+
+    std::array<std::shared_ptr<GameEntry>, MAX_BATCH> entries;
+    std::array<std::unique_lock<std::mutex>, MAX_BATCH> locks;
+    for (size_t i = 0; i < game_count; ++i) {
+        entries[i] = games.Find(lobby_ids[i]);
+        if (entries[i] != nullptr) {
+            locks[i] = std::unique_lock<std::mutex>(entries[i]->mutex);
+            entries[i]->game.Touch();
+        }
+    }
+
+    std::string output;
+    for (size_t i = 0; i < requests.Size(); ++i) {
+        const Request& request = requests[i];
+        std::string response;
+        if (IsGameCommand(request.command)) {
+            size_t index = std::lower_bound(lobby_ids.begin(), lobby_ids.begin() + game_count, request.id & MASK_OFF) -
+                           lobby_ids.begin();
+            const CommandHandler& handler = HANDLERS[static_cast<size_t>(request.command)];
+            bool rejected = entries[index] == nullptr || entries[index]->evicted ||
+                            (handler.mutates && move_log.IsFailed());
+            response = rejected ? "-" : (this->*handler.game_handler)(request, *entries[index], session);
+        } else {
+            response = HandleRequest(request, session);
+        }
 
-            return games.at(lobby_id).GetChessboard().GetCurrentTurn() == Color::WHITE ? "w" : "b";
+        if (binary) {
+            size_t size = std::min<size_t>(response.size(), 0xFFFF);
+            output += static_cast<char>(size & 0xFF);
+            output += static_cast<char>(size >> 8);
+            output.append(response, 0, size);
+        } else {
+            if (i != 0) {
+                output += '\n';
+            }
+            output += response;
         }
     }
+    return output;
+}
 
-    return "-";
+
+std::string Server::GetLobbies(const Request&, const std::shared_ptr<Session>&) {
+    std::lock_guard<std::mutex> guard(lobbies_mutex);
+    std::string output;
+    for (auto&[game_id, player] : lobbies) {
+        output += std::to_string(game_id);
+        output += ' ';
+        output += player;
+        output += ' ';
+    }
+
+    return output;
+}
+
+std::string Server::GetBotStats(const Request&, const std::shared_ptr<Session>&) {
+    // GET BOTSTATS - <переборов> <узлов> <узлов в секунду> <средняя глубина>
+    //                <запросов игроков> <среднее время запроса, мкс> <максимальное время запроса, мкс>
+    SearchStats stats = searcher.GetStats();
+    Metrics::RequestTotals requests = Metrics::Instance().GetRequestTotals();
+    std::ostringstream output;
+    output << stats.searches << " " << stats.nodes << " "
+           << (stats.microseconds ? stats.nodes * 1000000 / stats.microseconds : 0) << " "
+           << (stats.searches ? static_cast<double>(stats.depth_sum) / stats.searches : 0.0) << " "
+           << requests.count << " "
+           << (requests.count ? requests.nanoseconds / requests.count / 1000 : 0)
+           << " " << requests.max_nanoseconds / 1000;
+
+    return output.str();
+}
+
+std::string Server::LobbyEnter(const Request& request, const std::shared_ptr<Session>&) {
+    std::lock_guard<std::mutex> guard(lobbies_mutex);
+    unsigned int lobby_id = request.id;
+    if (!lobbies.erase(lobby_id)) {
+        return "-";
+    }
+    move_log.Append(MakeRecord(LogRecordType::LOBBY_ENTER, lobby_id));
+    games.Emplace(lobby_id, Game(lobby_id, lobby_id + 1));
+    PublishLobby("EVENT LOBBY ENTER " + std::to_string(lobby_id));
+    return std::to_string(lobby_id + 1);
+}
+
+std::string Server::LobbyCreate(const Request& request, const std::shared_ptr<Session>&) {
+    std::lock_guard<std::mutex> guard(lobbies_mutex);
+    unsigned int lobby_id;
+    {
+        std::lock_guard guard(id_mutex);
+        lobby_id = id;
+        id += 2;
+    }
+    std::string nickname(request.nickname);
+    LogRecord record = MakeRecord(LogRecordType::LOBBY_CREATE, lobby_id);
+    record.nickname = nickname;
+    move_log.Append(record);
+    PublishLobby("EVENT LOBBY CREATE " + std::to_string(lobby_id) + " " + nickname);
+    lobbies.emplace(lobby_id, std::move(nickname));
+    return std::to_string(lobby_id);
+}
+
+std::string Server::LobbyBot(const Request& request, const std::shared_ptr<Session>&) {
+    // LOBBY BOT [время на ход бота, мс] - партия против бота, игрок ходит белыми
+    uint32_t budget_ms = request.has_id ? std::clamp<uint32_t>(request.id, 10, 10000) : 500;
+
+    // Как и LOBBY ENTER, под lobbies_mutex: контрольная точка не попадет между записью B и созданием партии
+    std::lock_guard<std::mutex> guard(lobbies_mutex);
+    unsigned int lobby_id;
+    {
+        std::lock_guard guard(id_mutex);
+        lobby_id = id;
+        id += 2;
+    }
+
+    move_log.Append(MakeRecord(LogRecordType::BOT_GAME, lobby_id, budget_ms));
+    games.Emplace(lobby_id, Game(lobby_id, lobby_id + 1),
+                  Bot(Color::BLACK, std::chrono::milliseconds(budget_ms)));
+    return std::to_string(lobby_id);
+}
+
+std::string Server::LobbyRefresh(const Request& request, const std::shared_ptr<Session>&) {
+    std::lock_guard<std::mutex> guard(lobbies_mutex);
+    if (lobbies.count(request.id)) {
+        return "-";
+    }
+
+    return std::to_string(request.id);
+}
+
+std::string Server::LobbyDelete(const Request& request, const std::shared_ptr<Session>&) {
+    std::lock_guard<std::mutex> guard(lobbies_mutex);
+    if (lobbies.erase(request.id)) {
+        move_log.Append(MakeRecord(LogRecordType::LOBBY_DELETE, request.id));
+        PublishLobby("EVENT LOBBY DELETE " + std::to_string(request.id));
+    }
+
+    return "";
 }
 
+std::string Server::LobbySubscribe(const Request& request, const std::shared_ptr<Session>& session) {
+    // LOBBY SUBSCRIBE - присылать события лобби вместо опроса GET LOBBIES и LOBBY REFRESH
+    if (session == nullptr) {
+        return "-";
+    }
+    std::lock_guard<std::mutex> guard(lobbies_mutex);
+    lobby_subscribers.erase(std::remove_if(lobby_subscribers.begin(), lobby_subscribers.end(),
+                                           [&](const std::weak_ptr<Session>& subscriber) {
+        std::shared_ptr<Session> other = subscriber.lock();
+        return other == nullptr || other == session;
+    }), lobby_subscribers.end());
+    if (request.command == Command::LOBBY_SUBSCRIBE) {
+        lobby_subscribers.push_back(session);
+    }
+    return "+";
+}
+
+std::string Server::AdminLog(const Request& request, const std::shared_ptr<Session>& session) {
+    // ADMIN LOG [уровень] - <уровень> <записей в журнале> <отброшено при переполнении>
+    // Только с локального адреса: иначе любой клиент мог бы включить подробный журнал
+    if (session == nullptr || !session->IsLoopback()) {
+        return "-";
+    }
+    Logger& logger = Logger::Instance();
+    if (request.has_id) {
+        logger.SetLevel(static_cast<LogLevel>(request.id));
+    }
+    return std::string(LogLevelName(logger.GetLevel())) + " " + std::to_string(logger.Written()) + " " +
+           std::to_string(logger.Dropped());
+}
+
+
+std::string Server::GameBoard(const Request& request, GameEntry& entry, const std::shared_ptr<Session>&) {
+    Chessboard& chessboard = entry.game.GetChessboard();
+    return Timed(EngineOperation::FOW_FEN, [&]() { return chessboard.GetFOWFen(PlayerColor(request.id)); });
+}
+
+std::string Server::GameDelta(const Request& request, GameEntry& entry, const std::shared_ptr<Session>&) {
+    // GAME DELTA <game_id> <version> - изменения доски с версии, полученной клиентом ранее
+    std::optional<uint64_t> since;
+    if (request.has_version) {
+        since = request.version;
+    }
 
+    return entry.game.GetBoardDelta(PlayerColor(request.id), since);
+}
+
+std::string Server::GameMove(const Request& request, GameEntry& entry, const std::shared_ptr<Session>&) {
+    // GAME MOVE <game_id> <откуда> <куда> <превращение или "->
+    Chessboard& chessboard = entry.game.GetChessboard();
+    if (chessboard.GetCurrentTurn() != PlayerColor(request.id)) {
+        return "-";
+    }
+    if (entry.bot.has_value() && chessboard.GetCurrentTurn() == entry.bot->GetColor()) {
+        return "-";
+    }
+    if (entry.game.GetStatus() == GameStatus::ABANDONED) {
+        return "-";
+    }
+
+    if (!Timed(EngineOperation::MAKE_MOVE, [&]() { return chessboard.MakeMove(request.move); })) {
+        return "-";
+    }
+    unsigned int lobby_id = request.id & MASK_OFF;
+    LogRecord record = MakeRecord(LogRecordType::MOVE, lobby_id);
+    record.move = request.move;
+    move_log.Append(record);
+    entry.game.UpdateStatus();
+
+    PublishGame(lobby_id, entry);
+    if (entry.bot.has_value()) {
+        ScheduleBotMove(lobby_id);
+    }
+    return "+";
+}
+
+std::string Server::GameTakeback(const Request& request, GameEntry& entry, const std::shared_ptr<Session>&) {
+    // GAME TAKEBACK <game_id> - предложить сопернику отменить свой последний ход, пока он не ответил.
+    // Ход отменяется только после GAME ACCEPT соперника: иначе ходом-разведкой можно было бы
+    // бесплатно заглядывать под "туман войны", а отменой мата - продолжать законченную партию
+    Chessboard& chessboard = entry.game.GetChessboard();
+    Color player_color = PlayerColor(request.id);
+    if (chessboard.GetCurrentTurn() == player_color || entry.game.GetStatus() == GameStatus::ABANDONED ||
+        chessboard.Result() != Result::IN_PROGRESS || chessboard.GetPlayedMoveCount() == 0) {
+        return "-";
+    }
+    // Бот отмену хода не принимает
+    if (entry.bot.has_value()) {
+        return "-";
+    }
+
+    entry.takeback_offer = player_color;
+    entry.takeback_version = chessboard.GetVersion();
+    std::string event = "EVENT TAKEBACK " + std::to_string(request.id);
+    for (const auto& [subscriber, color] : entry.subscribers) {
+        std::shared_ptr<Session> session = subscriber.lock();
+        if (session != nullptr && color != player_color) {
+            session->Send(event);
+        }
+    }
+    return "+";
+}
+
+std::string Server::GameAccept(const Request& request, GameEntry& entry, const std::shared_ptr<Session>&) {
+    // GAME ACCEPT <game_id> - согласиться на отмену последнего хода соперника
+    Chessboard& chessboard = entry.game.GetChessboard();
+    if (!entry.takeback_offer.has_value() || *entry.takeback_offer == PlayerColor(request.id) ||
+        entry.takeback_version != chessboard.GetVersion() || entry.game.GetStatus() == GameStatus::ABANDONED ||
+        chessboard.Result() != Result::IN_PROGRESS) {
+        return "-";
+    }
+
+    entry.takeback_offer.reset();
+    if (!chessboard.UnmakeMove()) {
+        return "-";
+    }
+    unsigned int lobby_id = request.id & MASK_OFF;
+    move_log.Append(MakeRecord(LogRecordType::TAKEBACK, lobby_id));
+    entry.game.UpdateStatus();
+    PublishGame(lobby_id, entry);
+    if (entry.bot.has_value() && chessboard.GetCurrentTurn() == entry.bot->GetColor()) {
+        ScheduleBotMove(lobby_id);
+    }
+    return "+";
+}
+
+std::string Server::GameResult(const Request&, GameEntry& entry, const std::shared_ptr<Session>&) {
+    return ResultCode(entry.game.GetChessboard().Result());
+}
+
+std::string Server::GameTurn(const Request&, GameEntry& entry, const std::shared_ptr<Session>&) {
+    return entry.game.GetChessboard().GetCurrentTurn() == Color::WHITE ? "w" : "b";
+}
+
+std::string Server::GameSubscribe(const Request& request, GameEntry& entry, const std::shared_ptr<Session>& session) {
+    // GAME SUBSCRIBE <game_id> - присылать ходы, кадр игрока и результат вместо опроса
+    if (session == nullptr) {
+        return "-";
+    }
+    Color player_color = PlayerColor(request.id);
+    auto& subscribers = entry.subscribers;
+    subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(), [&](const auto& subscriber) {
+        std::shared_ptr<Session> other = subscriber.first.lock();
+        return other == nullptr || (other == session && subscriber.second == player_color);
+    }), subscribers.end());
+    if (request.command == Command::GAME_SUBSCRIBE) {
+        subscribers.emplace_back(session, player_color);
+    }
+    return "+";
+}
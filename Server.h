@@ -1,17 +1,30 @@
 #pragma once
 
-#include "engine/Game.h"
+#include "GameRegistry.h"
+#include "MoveLog.h"
+#include "Protocol.h"
+#include "engine/Search.h"
 
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/strand.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
 #include <cstdlib>
+#include <deque>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <unordered_map>
 #include <mutex>
+#include <vector>
 
 namespace beast = boost::beast;         // from <boost/beast.hpp>
 namespace http = beast::http;           // from <boost/beast/http.hpp>
@@ -19,20 +32,133 @@ namespace websocket = beast::websocket; // from <boost/beast/websocket.hpp>
 namespace net = boost::asio;            // from <boost/asio.hpp>
 using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
 
-using games_map = std::unordered_map<unsigned int, Game>;
 using lobbies_map = std::unordered_map<unsigned int, std::string>;
 
+class Session;
+
 class Server {
 public:
     Server() = default;
-    void DoSession(tcp::socket &socket);
-    void Run(int argc, char* argv[]);
-    std::string HandleRequest(const std::string& request);
+    // Код завершения процесса: EXIT_FAILURE, если сервер не смог запуститься
+    int Run(int argc, char* argv[]);
+    // Запрос в текстовом формате. session нужен командам подписки, без него они отвечают "-"
+    std::string HandleRequest(std::string_view request, const std::shared_ptr<Session>& session = nullptr);
+    // Разобранный запрос любого формата: обработчик выбирается по таблице HANDLERS
+    std::string HandleRequest(const Request& request, const std::shared_ptr<Session>& session);
+    /**
+     * Выполняет запрос и передает ответ в session->Respond. Запросы GAME выполняются на strand партии,
+     * поэтому запросы к одной партии не идут параллельно, остальные - сразу в вызывающем потоке.
+     */
+    void Dispatch(const std::shared_ptr<Session>& session, const Request& request);
+    // Показатели для GET /metrics в текстовом формате Prometheus: Metrics и состояние сервера
+    std::string MetricsText();
 private:
+    // Тесты ходят за бота напрямую, без потока BotLoop
+    friend class ServerTest;
+
+    using Handler = std::string (Server::*)(const Request&, const std::shared_ptr<Session>&);
+    // Обработчик команды GAME: партия уже найдена и заблокирована
+    using GameHandler = std::string (Server::*)(const Request&, GameEntry&, const std::shared_ptr<Session>&);
+    struct CommandHandler {
+        Handler handler = nullptr;
+        GameHandler game_handler = nullptr;
+        // Команда пишет в журнал - отвергается, если журнал не смог записать изменения
+        bool mutates = false;
+    };
+    // Индекс - Command
+    static const std::array<CommandHandler, COMMAND_COUNT> HANDLERS;
+    static bool IsGameCommand(Command command);
+    /**
+     * Пакет BATCH: каждая партия пакета ищется в реестре и блокируется один раз на весь пакет.
+     * Ответы по порядку запросов: в текстовом формате - через '\n', в двоичном - перед каждым u16 длина.
+     */
+    std::string HandleBatch(const BatchRequests& requests, bool binary, const std::shared_ptr<Session>& session);
+
+    std::string GetLobbies(const Request& request, const std::shared_ptr<Session>& session);
+    std::string GetBotStats(const Request& request, const std::shared_ptr<Session>& session);
+    std::string LobbyEnter(const Request& request, const std::shared_ptr<Session>& session);
+    std::string LobbyCreate(const Request& request, const std::shared_ptr<Session>& session);
+    std::string LobbyBot(const Request& request, const std::shared_ptr<Session>& session);
+    std::string LobbyRefresh(const Request& request, const std::shared_ptr<Session>& session);
+    std::string LobbyDelete(const Request& request, const std::shared_ptr<Session>& session);
+    std::string LobbySubscribe(const Request& request, const std::shared_ptr<Session>& session);
+    std::string AdminLog(const Request& request, const std::shared_ptr<Session>& session);
+    std::string GameBoard(const Request& request, GameEntry& entry, const std::shared_ptr<Session>& session);
+    std::string GameDelta(const Request& request, GameEntry& entry, const std::shared_ptr<Session>& session);
+    std::string GameMove(const Request& request, GameEntry& entry, const std::shared_ptr<Session>& session);
+    std::string GameTakeback(const Request& request, GameEntry& entry, const std::shared_ptr<Session>& session);
+    std::string GameAccept(const Request& request, GameEntry& entry, const std::shared_ptr<Session>& session);
+    std::string GameResult(const Request& request, GameEntry& entry, const std::shared_ptr<Session>& session);
+    std::string GameTurn(const Request& request, GameEntry& entry, const std::shared_ptr<Session>& session);
+    std::string GameSubscribe(const Request& request, GameEntry& entry, const std::shared_ptr<Session>& session);
+
+    using strand = net::strand<net::io_context::executor_type>;
+    strand& GameStrand(unsigned int lobby_id);
+    // Ходы ботов делают потоки BotLoop по общей очереди партий, в которых бот должен ходить
+    void BotLoop();
+    void ScheduleBotMove(unsigned int lobby_id);
+    void PlayBotMove(unsigned int lobby_id);
+    /**
+     * Раз в REAP_INTERVAL удаляет из реестра законченные партии (через finished_ttl после конца)
+     * и брошенные: без запросов игроков и живых подписчиков дольше abandon_timeout
+     * или без ходов дольше idle_timeout. Удаляемые партии дописываются в archive, если он открыт.
+     */
+    void ReaperLoop();
+    void ReapGames();
+    // Восстановление лобби и партий из журнала, до запуска потоков
+    void Replay(const LogRecord& record);
+    // Контрольная точка журнала: следующий номер лобби, открытые лобби и снимки всех партий
+    // (упакованная позиция и последние обратимые ходы, см. Chessboard::GetSnapshot)
+    void Checkpoint();
+    /**
+     * События подписок. Вызываются под блокировкой партии (entry.mutex) или lobbies_mutex,
+     * Session::Send только ставит сообщение в очередь соединения.
+     * "EVENT GAME <game_id> <версия> <результат, как GAME RESULT> <GetFOWFen игрока>",
+     * "EVENT TAKEBACK <game_id соперника>" - соперник предлагает отменить свой ход (см. GAME ACCEPT)
+     * "EVENT LOBBY CREATE <lobby_id> <ник>", "EVENT LOBBY ENTER <lobby_id>", "EVENT LOBBY DELETE <lobby_id>"
+     */
+    void PublishGame(unsigned int lobby_id, GameEntry& entry);
+    void PublishLobby(const std::string& event);
+
     unsigned int id = 0;
     std::mutex id_mutex;
-    games_map games;
-    std::mutex games_mutex;
+    GameRegistry games;
     lobbies_map lobbies;
     std::mutex lobbies_mutex;
+    // Подписанные на события лобби (LOBBY SUBSCRIBE), защищается lobbies_mutex
+    std::vector<std::weak_ptr<Session>> lobby_subscribers;
+
+    // Запросы партий распределяются по фиксированному числу strand по номеру партии
+    static constexpr size_t GAME_STRANDS = 256;
+    std::vector<strand> game_strands;
+    unsigned int io_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Бот ходит черными и хранится в записи партии (GameEntry::bot). Всего на ботов не больше
+    // bot_threads потоков: bot_threads / bot_search_threads потоков BotLoop, каждый перебор -
+    // в bot_search_threads потоках; таблица транспозиций searcher общая для всех переборов
+    static constexpr unsigned int BOT_SEARCH_THREADS = 2;
+    Searcher searcher;
+    unsigned int bot_threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+    unsigned int bot_search_threads = 1;
+    std::deque<unsigned int> bot_queue;
+    std::mutex bot_queue_mutex;
+    std::condition_variable bot_queue_cv;
+
+    // Сроки жизни партий, в секундах задаются переменными окружения FOG_CHESS_FINISHED_TTL,
+    // FOG_CHESS_ABANDON_TIMEOUT и FOG_CHESS_IDLE_TIMEOUT
+    static constexpr std::chrono::seconds REAP_INTERVAL{5};
+    std::chrono::seconds finished_ttl{60};
+    std::chrono::seconds abandon_timeout{5 * 60};
+    std::chrono::seconds idle_timeout{30 * 60};
+    // Файл из FOG_CHESS_ARCHIVE: строка "<lobby_id> <статус> <результат> <версия> <FEN>" на удаленную партию
+    FILE* archive = nullptr;
+    std::atomic<uint64_t> games_evicted{0};
+
+    // Журнал событий из FOG_CHESS_WAL. Записи о партии дописываются под ее блокировкой,
+    // записи о лобби и создании партий (LOBBY ENTER, LOBBY BOT) - под lobbies_mutex вместе с самим
+    // изменением, поэтому порядок в журнале совпадает с порядком изменений, а снимок партий в
+    // Checkpoint, сделанный после lobbies_mutex, видит каждую партию, запись о создании которой старше точки.
+    // Контрольная точка - когда журнал с прошлой точки вырос больше CHECKPOINT_BYTES и размера самой точки.
+    MoveLog move_log;
+    static constexpr uint64_t CHECKPOINT_BYTES = 4 << 20;
 };
@@ -0,0 +1,237 @@
+#include "Session.h"
+#include "Logger.h"
+#include "Metrics.h"
+
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/post.hpp>
+
+namespace {
+
+    // Клиент закрыл соединение или сервер сам его закрыл - это не ошибка
+    bool IsDisconnect(const beast::error_code& ec) {
+        return ec == net::error::eof || ec == net::error::connection_reset || ec == net::error::broken_pipe ||
+               ec == net::error::operation_aborted || ec == http::error::end_of_stream ||
+               ec == beast::error::timeout || ec == websocket::error::closed;
+    }
+
+    void LogSessionError(const beast::error_code& ec) {
+        Log(IsDisconnect(ec) ? LogLevel::DEBUG : LogLevel::ERROR, "Session error: ", ec.message());
+    }
+
+}
+
+Session::Session(tcp::socket&& socket, Server& server)
+        : ws(std::move(socket)), server(server) {
+    beast::error_code ec;
+    net::ip::address address = beast::get_lowest_layer(ws).socket().remote_endpoint(ec).address();
+    if (address.is_v6() && address.to_v6().is_v4_mapped()) {
+        address = net::ip::make_address_v4(net::ip::v4_mapped, address.to_v6());
+    }
+    loopback = !ec && address.is_loopback();
+}
+
+Session::~Session() {
+    if (counted) {
+        Metrics::Instance().SessionClosed();
+    }
+}
+
+void Session::Run() {
+    // Все обработчики соединения должны выполняться на его strand
+    net::dispatch(ws.get_executor(), beast::bind_front_handler(&Session::OnRun, shared_from_this()));
+}
+
+void Session::OnRun() {
+    // Сначала читается HTTP-запрос, чтобы отличить websocket от GET /metrics
+    beast::get_lowest_layer(ws).expires_after(std::chrono::seconds(30));
+    http::async_read(ws.next_layer(), buffer, http_request,
+                     beast::bind_front_handler(&Session::OnHttpRead, shared_from_this()));
+}
+
+void Session::OnHttpRead(beast::error_code ec, std::size_t) {
+    if (ec) {
+        LogSessionError(ec);
+        return;
+    }
+
+    if (!websocket::is_upgrade(http_request)) {
+        bool metrics = http_request.method() == http::verb::get && http_request.target() == "/metrics";
+        http_response = http::response<http::string_body>(metrics ? http::status::ok : http::status::not_found,
+                                                          http_request.version());
+        http_response.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+        http_response.set(http::field::content_type, metrics ? "text/plain; version=0.0.4" : "text/plain");
+        http_response.body() = metrics ? server.MetricsText() : "Not found\n";
+        http_response.keep_alive(false);
+        http_response.prepare_payload();
+        http::async_write(ws.next_layer(), http_response,
+                          beast::bind_front_handler(&Session::OnHttpWrite, shared_from_this()));
+        return;
+    }
+
+    // Таймауты websocket заменяют таймаут чтения HTTP-запроса
+    beast::get_lowest_layer(ws).expires_never();
+    ws.set_option(websocket::stream_base::timeout::suggested(beast::role_type::server));
+    ws.set_option(websocket::stream_base::decorator(
+            [](websocket::response_type &res) {
+                res.set(http::field::server,
+                        std::string(BOOST_BEAST_VERSION_STRING) +
+                        " websocket-server-async");
+            }));
+
+    buffer.consume(buffer.size());
+    ws.async_accept(http_request, beast::bind_front_handler(&Session::OnAccept, shared_from_this()));
+}
+
+void Session::OnHttpWrite(beast::error_code ec, std::size_t) {
+    if (ec) {
+        Log(LogLevel::ERROR, "Session error: ", ec.message());
+    }
+    beast::get_lowest_layer(ws).socket().shutdown(tcp::socket::shutdown_send, ec);
+}
+
+void Session::OnAccept(beast::error_code ec) {
+    if (ec) {
+        Log(LogLevel::ERROR, "Session error: ", ec.message());
+        return;
+    }
+
+    counted = true;
+    Metrics::Instance().SessionOpened();
+    DoRead();
+}
+
+void Session::DoRead() {
+    ws.async_read(buffer, beast::bind_front_handler(&Session::OnRead, shared_from_this()));
+}
+
+void Session::OnRead(beast::error_code ec, std::size_t) {
+    // This indicates that the session was closed
+    if (ec == websocket::error::closed) {
+        closed = true;
+        return;
+    }
+    if (ec) {
+        closed = true;
+        LogSessionError(ec);
+        return;
+    }
+
+    ws.text(ws.got_text());
+    in_request = true;
+
+    // Запрос разбирается прямо в буфере: следующее чтение начнется только после ответа
+    std::string_view message(static_cast<const char*>(buffer.data().data()), buffer.size());
+    // Каждый запрос - только на уровне DEBUG, иначе журнал по умолчанию растет с каждым ходом
+    if (!binary) {
+        Log(LogLevel::DEBUG, message);
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    Request request;
+    if (!(binary ? ParseBinaryRequest(message, request) : ParseTextRequest(message, request))) {
+        Metrics::Instance().RecordRequest(Command::COUNT, std::chrono::steady_clock::now() - started, true);
+        Respond("-");
+        return;
+    }
+    if (request.command == Command::PROTOCOL) {
+        // PROTOCOL TEXT|BINARY - формат следующих запросов этого соединения
+        binary = request.id != 0;
+        Metrics::Instance().RecordRequest(Command::PROTOCOL, std::chrono::steady_clock::now() - started, false);
+        Respond("+");
+        return;
+    }
+
+    server.Dispatch(shared_from_this(), request);
+}
+
+void Session::Respond(std::string response) {
+    // Ответ может быть готов на strand партии - возвращаемся на strand соединения
+    net::post(ws.get_executor(), [self = shared_from_this(), response = std::move(response)]() mutable {
+        self->in_request = false;
+        self->buffer.consume(self->buffer.size());
+        self->Enqueue(std::move(response));
+        for (std::string& event : self->held_events) {
+            self->Enqueue(std::move(event));
+        }
+        self->held_events.clear();
+        if (!self->closed) {
+            self->DoRead();
+        }
+    });
+}
+
+bool Session::IsLoopback() const {
+    return loopback;
+}
+
+void Session::Send(std::string message) {
+    net::post(ws.get_executor(), [self = shared_from_this(), message = std::move(message)]() mutable {
+        if (self->in_request) {
+            self->held_events.push_back(std::move(message));
+        } else {
+            self->Enqueue(std::move(message));
+        }
+    });
+}
+
+void Session::Enqueue(std::string message) {
+    if (closed) {
+        return;
+    }
+    if (outbox.size() >= MAX_OUTBOX) {
+        // Незавершенные чтение и запись закончатся с ошибкой, и соединение освободится
+        Log(LogLevel::WARNING, "Client is too slow, closing session");
+        closed = true;
+        ws.next_layer().close();
+        return;
+    }
+
+    outbox.push_back(std::move(message));
+    if (outbox.size() == 1) {
+        DoWrite();
+    }
+}
+
+void Session::DoWrite() {
+    ws.async_write(net::buffer(outbox.front()), beast::bind_front_handler(&Session::OnWrite, shared_from_this()));
+}
+
+void Session::OnWrite(beast::error_code ec, std::size_t) {
+    if (ec) {
+        closed = true;
+        LogSessionError(ec);
+        return;
+    }
+
+    outbox.pop_front();
+    if (!outbox.empty()) {
+        DoWrite();
+    }
+}
+
+
+Listener::Listener(net::io_context& ioc, const tcp::endpoint& endpoint, Server& server)
+        : ioc(ioc), acceptor(ioc), server(server) {
+    acceptor.open(endpoint.protocol());
+    acceptor.set_option(net::socket_base::reuse_address(true));
+    acceptor.bind(endpoint);
+    acceptor.listen(net::socket_base::max_listen_connections);
+}
+
+void Listener::Run() {
+    DoAccept();
+}
+
+void Listener::DoAccept() {
+    acceptor.async_accept(net::make_strand(ioc), beast::bind_front_handler(&Listener::OnAccept, shared_from_this()));
+}
+
+void Listener::OnAccept(beast::error_code ec, tcp::socket socket) {
+    if (ec) {
+        Log(LogLevel::ERROR, "Session error: ", ec.message());
+    } else {
+        std::make_shared<Session>(std::move(socket), server)->Run();
+    }
+
+    DoAccept();
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Server.h"
+
+#include <boost/asio/strand.hpp>
+#include <deque>
+#include <memory>
+#include <string>
+
+/**
+ * Websocket-соединение одного клиента. Все операции соединения выполняются на его strand,
+ * поток ввода-вывода не блокируется: запрос читается, разбирается в текстовом или двоичном
+ * формате (см. Protocol.h) и передается в Server::Dispatch,
+ * следующий запрос читается, когда готов ответ на предыдущий. Ответы и события подписок
+ * записываются по очереди из outbox; события, пришедшие во время обработки запроса,
+ * отправляются после ответа на него.
+ * На том же порту отвечает на обычный HTTP-запрос GET /metrics (см. Server::MetricsText)
+ * и закрывает соединение.
+ */
+class Session : public std::enable_shared_from_this<Session> {
+public:
+    // Сообщений в очереди, после которого клиент считается не успевающим читать и отключается
+    static constexpr size_t MAX_OUTBOX = 256;
+
+    Session(tcp::socket&& socket, Server& server);
+    ~Session();
+    void Run();
+    // Ответ на прочитанный запрос; можно вызывать из любого потока
+    void Respond(std::string response);
+    // Событие подписки; можно вызывать из любого потока
+    void Send(std::string message);
+    // Клиент подключился с локального адреса: только такому разрешены команды ADMIN
+    bool IsLoopback() const;
+private:
+    void OnRun();
+    void OnHttpRead(beast::error_code ec, std::size_t bytes_transferred);
+    void OnHttpWrite(beast::error_code ec, std::size_t bytes_transferred);
+    void OnAccept(beast::error_code ec);
+    void DoRead();
+    void OnRead(beast::error_code ec, std::size_t bytes_transferred);
+    void Enqueue(std::string message);
+    void DoWrite();
+    void OnWrite(beast::error_code ec, std::size_t bytes_transferred);
+
+    websocket::stream<beast::tcp_stream> ws;
+    beast::flat_buffer buffer;
+    // Первый запрос соединения: переход на websocket или GET /metrics
+    http::request<http::string_body> http_request;
+    http::response<http::string_body> http_response;
+    std::deque<std::string> outbox;
+    std::deque<std::string> held_events;
+    bool in_request = false;
+    // Запросы в двоичном формате (после PROTOCOL BINARY)
+    bool binary = false;
+    bool closed = false;
+    // Соединение учтено в Metrics как открытая сессия
+    bool counted = false;
+    bool loopback = false;
+    Server& server;
+};
+
+/**
+ * Принимает соединения и создает для каждого Session на отдельном strand
+ */
+class Listener : public std::enable_shared_from_this<Listener> {
+public:
+    Listener(net::io_context& ioc, const tcp::endpoint& endpoint, Server& server);
+    void Run();
+private:
+    void DoAccept();
+    void OnAccept(beast::error_code ec, tcp::socket socket);
+
+    net::io_context& ioc;
+    tcp::acceptor acceptor;
+    Server& server;
+};
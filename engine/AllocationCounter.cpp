@@ -0,0 +1,55 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef FOG_CHESS_COUNT_ALLOCATIONS
+
+namespace {
+    std::atomic<size_t> allocation_count{0};
+
+    void* CountedAllocate(size_t size) {
+        allocation_count.fetch_add(1, std::memory_order_relaxed);
+        if (void* ptr = std::malloc(size ? size : 1)) {
+            return ptr;
+        }
+        throw std::bad_alloc();
+    }
+}
+
+void* operator new(size_t size) {
+    return CountedAllocate(size);
+}
+
+void* operator new[](size_t size) {
+    return CountedAllocate(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+size_t AllocationCount() noexcept {
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+#else
+
+size_t AllocationCount() noexcept {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * Количество выделений памяти в куче с начала работы программы.
+ * Считается только при сборке с FOG_CHESS_COUNT_ALLOCATIONS (опция COUNT_ALLOCATIONS в CMake),
+ * которая подменяет глобальный operator new. Иначе всегда 0.
+ */
+size_t AllocationCount() noexcept;
@@ -0,0 +1,75 @@
+#include "Bitboard.h"
+
+namespace {
+
+    constexpr Bitboard North(Bitboard b) { return b << 8; }
+    constexpr Bitboard South(Bitboard b) { return b >> 8; }
+    constexpr Bitboard East(Bitboard b) { return (b & ~FILE_H) << 1; }
+    constexpr Bitboard West(Bitboard b) { return (b & ~FILE_A) >> 1; }
+    constexpr Bitboard NorthEast(Bitboard b) { return (b & ~FILE_H) << 9; }
+    constexpr Bitboard NorthWest(Bitboard b) { return (b & ~FILE_A) << 7; }
+    constexpr Bitboard SouthEast(Bitboard b) { return (b & ~FILE_H) >> 7; }
+    constexpr Bitboard SouthWest(Bitboard b) { return (b & ~FILE_A) >> 9; }
+
+    // Сдвиг на одну клетку в направлении Direction (порядок как в перечислении)
+    constexpr Bitboard Step(int direction, Bitboard b) {
+        switch (direction) {
+            case NORTH: return North(b);
+            case EAST: return East(b);
+            case NORTH_EAST: return NorthEast(b);
+            case NORTH_WEST: return NorthWest(b);
+            case SOUTH: return South(b);
+            case WEST: return West(b);
+            case SOUTH_WEST: return SouthWest(b);
+            default: return SouthEast(b);
+        }
+    }
+
+    constexpr AttackTables MakeAttackTables() {
+        AttackTables tables{};
+
+        for (int square = 0; square < 64; ++square) {
+            Bitboard b = SquareBB(square);
+
+            tables.pawn[static_cast<int>(Color::WHITE)][square] = NorthEast(b) | NorthWest(b);
+            tables.pawn[static_cast<int>(Color::BLACK)][square] = SouthEast(b) | SouthWest(b);
+
+            Bitboard one = East(b) | West(b);
+            Bitboard two = East(East(b)) | West(West(b));
+            tables.knight[square] = (one << 16) | (one >> 16) | (two << 8) | (two >> 8);
+
+            Bitboard row = b | one;
+            tables.king[square] = (row | North(row) | South(row)) & ~b;
+
+            for (int direction = 0; direction < 8; ++direction) {
+                for (Bitboard ray = Step(direction, b); ray; ray = Step(direction, ray)) {
+                    tables.rays[direction][square] |= ray;
+                }
+            }
+        }
+
+        // Противоположное направление лежит в перечислении на 4 позиции дальше
+        for (int a = 0; a < 64; ++a) {
+            for (int direction = 0; direction < 8; ++direction) {
+                Bitboard ray = tables.rays[direction][a];
+                Bitboard full_line = ray | tables.rays[(direction + 4) % 8][a] | SquareBB(a);
+                for (int b = 0; b < 64; ++b) {
+                    if (ray & SquareBB(b)) {
+                        tables.between[a][b] = ray & ~tables.rays[direction][b] & ~SquareBB(b);
+                        tables.line[a][b] = full_line;
+                    }
+                }
+            }
+        }
+
+        return tables;
+    }
+
+}
+
+constexpr AttackTables ATTACKS = MakeAttackTables();
+
+Bitboard Neighbourhood(Bitboard b) noexcept {
+    Bitboard row = b | East(b) | West(b);
+    return row | North(row) | South(row);
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "Coords.h"
+#include "Figure.h"
+
+#include <cstdint>
+
+/**
+ * Битовая доска: бит с номером row * 8 + col соответствует клетке (row, col).
+ * A1 - бит 0, H1 - бит 7, A8 - бит 56, H8 - бит 63.
+ */
+using Bitboard = uint64_t;
+
+constexpr Bitboard FILE_A = 0x0101010101010101ULL;
+constexpr Bitboard FILE_H = FILE_A << 7;
+constexpr Bitboard RANK_1 = 0xFFULL;
+constexpr Bitboard RANK_2 = RANK_1 << 8;
+constexpr Bitboard RANK_7 = RANK_1 << 48;
+constexpr Bitboard RANK_8 = RANK_1 << 56;
+
+inline bool IsOnBoard(Coords coords) noexcept {
+    return 0 <= coords.GetRow() && coords.GetRow() < 8 && 0 <= coords.GetCol() && coords.GetCol() < 8;
+}
+
+inline int SquareOf(Coords coords) noexcept {
+    return coords.GetRow() * 8 + coords.GetCol();
+}
+
+inline Coords CoordsOf(int square) noexcept {
+    return Coords(square / 8, square % 8);
+}
+
+constexpr Bitboard SquareBB(int square) noexcept {
+    return Bitboard(1) << square;
+}
+
+inline int PopCount(Bitboard b) noexcept {
+    return __builtin_popcountll(b);
+}
+
+/**
+ * Номер младшего установленного бита. Для b == 0 результат не определен
+ */
+inline int Lsb(Bitboard b) noexcept {
+    return __builtin_ctzll(b);
+}
+
+/**
+ * Возвращает номер младшего установленного бита и сбрасывает его
+ */
+inline int PopLsb(Bitboard& b) noexcept {
+    int square = Lsb(b);
+    b &= b - 1;
+    return square;
+}
+
+inline Color Opposite(Color color) noexcept {
+    return color == Color::WHITE ? Color::BLACK : Color::WHITE;
+}
+
+/**
+ * Номер старшего установленного бита. Для b == 0 результат не определен
+ */
+inline int Msb(Bitboard b) noexcept {
+    return 63 - __builtin_clzll(b);
+}
+
+/**
+ * Таблицы атак, вычисляемые при компиляции (см. Bitboard.cpp).
+ * Лучи rays[direction][square] идут от клетки до края доски, не включая саму клетку.
+ */
+enum Direction {
+    NORTH, EAST, NORTH_EAST, NORTH_WEST,    // номер клетки вдоль луча растет
+    SOUTH, WEST, SOUTH_WEST, SOUTH_EAST     // номер клетки вдоль луча убывает
+};
+
+struct AttackTables {
+    Bitboard pawn[2][64];
+    Bitboard knight[64];
+    Bitboard king[64];
+    Bitboard rays[8][64];
+    Bitboard between[64][64];
+    Bitboard line[64][64];
+};
+
+extern const AttackTables ATTACKS;
+
+/**
+ * Луч из square в направлении direction до первой фигуры из occupied включительно
+ */
+inline Bitboard RayAttacks(Direction direction, int square, Bitboard occupied) noexcept {
+    Bitboard ray = ATTACKS.rays[direction][square];
+    Bitboard blockers = ray & occupied;
+    if (blockers) {
+        int blocker = direction < SOUTH ? Lsb(blockers) : Msb(blockers);
+        ray ^= ATTACKS.rays[direction][blocker];
+    }
+
+    return ray;
+}
+
+/**
+ * Клетки, которые бьет фигура, стоящая на square, при занятости доски occupied.
+ * Для дальнобойных фигур луч включает первую встреченную фигуру любого цвета.
+ */
+inline Bitboard PawnAttacks(Color color, int square) noexcept {
+    return ATTACKS.pawn[static_cast<int>(color)][square];
+}
+
+inline Bitboard KnightAttacks(int square) noexcept {
+    return ATTACKS.knight[square];
+}
+
+inline Bitboard KingAttacks(int square) noexcept {
+    return ATTACKS.king[square];
+}
+
+inline Bitboard BishopAttacks(int square, Bitboard occupied) noexcept {
+    return RayAttacks(NORTH_EAST, square, occupied) | RayAttacks(NORTH_WEST, square, occupied) |
+           RayAttacks(SOUTH_EAST, square, occupied) | RayAttacks(SOUTH_WEST, square, occupied);
+}
+
+inline Bitboard RookAttacks(int square, Bitboard occupied) noexcept {
+    return RayAttacks(NORTH, square, occupied) | RayAttacks(SOUTH, square, occupied) |
+           RayAttacks(EAST, square, occupied) | RayAttacks(WEST, square, occupied);
+}
+
+/**
+ * Клетки строго между a и b, если они лежат на одной линии (иначе 0)
+ */
+inline Bitboard Between(int a, int b) noexcept {
+    return ATTACKS.between[a][b];
+}
+
+/**
+ * Вся линия (горизонталь, вертикаль или диагональ), проходящая через a и b (иначе 0)
+ */
+inline Bitboard Line(int a, int b) noexcept {
+    return ATTACKS.line[a][b];
+}
+
+/**
+ * Сами клетки b и все соседние с ними (квадраты 3x3 вокруг каждой клетки)
+ */
+Bitboard Neighbourhood(Bitboard b) noexcept;
@@ -0,0 +1,207 @@
+#include "Bot.h"
+
+#include "PackedPosition.h"
+#include "Sampler.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <string>
+
+Bot::Bot(Color color, std::chrono::milliseconds budget)
+        : _color(color), _budget(budget), _rng_state(color == Color::WHITE ? 1 : 2) {
+    // До первого хода противник стоит в начальной расстановке - это известно и без обзора
+    _memory.fill('+');
+    const char* pieces = _color == Color::WHITE ? "rnbqkbnr" : "RNBQKBNR";
+    int back_row = _color == Color::WHITE ? 7 : 0;
+    int pawn_row = _color == Color::WHITE ? 6 : 1;
+    for (int col = 0; col < 8; ++col) {
+        _memory[back_row * 8 + col] = pieces[col];
+        _memory[pawn_row * 8 + col] = _color == Color::WHITE ? 'p' : 'P';
+    }
+}
+
+
+Color Bot::GetColor() const {
+    return _color;
+}
+
+
+std::chrono::milliseconds Bot::GetBudget() const {
+    return _budget;
+}
+
+
+bool Bot::IsEnemy(char c) const {
+    bool white = std::isupper(static_cast<unsigned char>(c));
+    bool black = std::islower(static_cast<unsigned char>(c));
+    return _color == Color::WHITE ? black : white;
+}
+
+
+std::optional<Chessboard> Bot::GuessPosition(std::string_view fow_fen) {
+    // "<64 клетки> <очередь хода> <рокировки, возможно пустые> <взятие на проходе> <счетчики>"
+    if (fow_fen.size() < 67 || fow_fen[64] != ' ') {
+        return std::nullopt;
+    }
+    std::string_view frame = fow_fen.substr(0, 64);
+
+    // Фигура, увиденная на новом месте, уходит из памяти о ближайшей невидимой клетке
+    FogFrame previous = _memory;
+    for (int square = 0; square < 64; ++square) {
+        if (frame[square] != '-') {
+            _memory[square] = IsEnemy(frame[square]) ? frame[square] : '+';
+        }
+    }
+    for (int square = 0; square < 64; ++square) {
+        if (!IsEnemy(frame[square]) || previous[square] == frame[square]) {
+            continue;
+        }
+
+        int nearest = -1;
+        int nearest_distance = 8;
+        for (int other = 0; other < 64; ++other) {
+            if (frame[other] != '-' || _memory[other] != frame[square]) {
+                continue;
+            }
+            int distance = std::max(std::abs(other / 8 - square / 8), std::abs(other % 8 - square % 8));
+            if (distance < nearest_distance) {
+                nearest = other;
+                nearest_distance = distance;
+            }
+        }
+        if (nearest >= 0) {
+            _memory[nearest] = '+';
+        }
+    }
+
+    std::string_view tail = fow_fen.substr(65);
+    size_t castling_end = tail.find(' ', 2);
+    if (tail.size() < 2 || tail[1] != ' ' || castling_end == std::string_view::npos) {
+        return std::nullopt;
+    }
+    std::string_view castling = tail.substr(2, castling_end - 2);
+
+    // Поле взятия на проходе выдает пешку противника, только что сделавшую двойной ход
+    std::string_view en_passant = tail.substr(castling_end + 1, 2);
+    if (en_passant.size() == 2 && en_passant[0] != '-') {
+        int col = std::toupper(static_cast<unsigned char>(en_passant[0])) - 'A';
+        int row = en_passant[1] - '1';
+        if (col < 0 || col >= 8 || (row != 2 && row != 5)) {
+            return std::nullopt;
+        }
+        int pawn = (row == 2 ? 3 : 4) * 8 + col;
+        int start = (row == 2 ? 1 : 6) * 8 + col;
+        _memory[pawn] = row == 2 ? 'P' : 'p';
+        if (frame[start] == '-') {
+            _memory[start] = '+';
+        }
+    }
+
+    // Запомненная картина может оказаться невозможной (король противника под ударом, лишние фигуры
+    // после превращений) - тогда позиция выбирается случайно среди согласованных с обзором
+    Chessboard position;
+    if (position.SetFen(MemoryFen(frame, tail, castling, castling_end)) &&
+        !position.IsCheck(Opposite(position.GetCurrentTurn()))) {
+        return position;
+    }
+    if (std::optional<Chessboard> sampled = SamplePosition(fow_fen)) {
+        return sampled;
+    }
+
+    // Совсем без согласованной позиции перебор идет без запомненного короля противника
+    for (int square = 0; square < 64; ++square) {
+        if (frame[square] == '-' && std::tolower(static_cast<unsigned char>(_memory[square])) == 'k') {
+            _memory[square] = '+';
+        }
+    }
+    if (position.SetFen(MemoryFen(frame, tail, castling, castling_end))) {
+        return position;
+    }
+
+    return std::nullopt;
+}
+
+
+std::string Bot::MemoryFen(std::string_view frame, std::string_view tail, std::string_view castling,
+                           size_t castling_end) const {
+    std::string fen;
+    for (int row = 7; row >= 0; --row) {
+        int empty = 0;
+        for (int col = 0; col < 8; ++col) {
+            int square = row * 8 + col;
+            char c = frame[square] != '-' ? frame[square] : _memory[square];
+            if (c == '+') {
+                ++empty;
+                continue;
+            }
+            if (empty) {
+                fen.push_back(static_cast<char>('0' + empty));
+                empty = 0;
+            }
+            fen.push_back(c);
+        }
+        if (empty) {
+            fen.push_back(static_cast<char>('0' + empty));
+        }
+        fen.push_back(row ? '/' : ' ');
+    }
+    fen.push_back(tail[0]);
+    fen.push_back(' ');
+    fen.append(castling.empty() ? std::string_view("-") : castling);
+    fen.append(tail.substr(castling_end));
+    return fen;
+}
+
+
+std::optional<Chessboard> Bot::SamplePosition(std::string_view fow_fen) {
+    std::optional<FogView> view = FogView::Parse(fow_fen);
+    if (!view.has_value()) {
+        return std::nullopt;
+    }
+
+    // Состав фигур противника - видимые и запомненные; взятия бот видит сам, поэтому счет обычно точен
+    Material material{};
+    for (int square = 0; square < 64; ++square) {
+        char c = view->frame[square] != '-' ? view->frame[square] : _memory[square];
+        if (!IsEnemy(c)) {
+            continue;
+        }
+        switch (std::tolower(static_cast<unsigned char>(c))) {
+            case 'p':
+                ++material[static_cast<int>(Figure::PAWN)];
+                break;
+            case 'n':
+                ++material[static_cast<int>(Figure::KNIGHT)];
+                break;
+            case 'b':
+                ++material[static_cast<int>(Figure::BISHOP)];
+                break;
+            case 'r':
+                ++material[static_cast<int>(Figure::ROOK)];
+                break;
+            case 'q':
+                ++material[static_cast<int>(Figure::QUEEN)];
+                break;
+            default:
+                break;
+        }
+    }
+    material[static_cast<int>(Figure::KING)] = 1;
+
+    PositionSampler sampler(*view, _color, material);
+    PackedPosition packed;
+    Chessboard position;
+    if (!sampler.Sample(_rng_state, packed) || !position.Unpack(packed)) {
+        return std::nullopt;
+    }
+
+    // Дальше бот помнит противника таким, каким его расставил выбор; свои фигуры противник видит всегда
+    FogFrame sampled = position.GetFOWFrame(Opposite(_color));
+    for (int square = 0; square < 64; ++square) {
+        if (view->frame[square] == '-') {
+            _memory[square] = IsEnemy(sampled[square]) ? sampled[square] : '+';
+        }
+    }
+    return position;
+}
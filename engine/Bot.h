@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Chessboard.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+/**
+ * Соперник-программа. Видит доску так же, как игрок, - только через GetFOWFen,
+ * и помнит, где последний раз видел фигуры противника.
+ */
+class Bot {
+public:
+    Bot(Color color, std::chrono::milliseconds budget);
+
+    Color GetColor() const;
+    // Время на обдумывание одного хода
+    std::chrono::milliseconds GetBudget() const;
+
+    /**
+     * Позиция для перебора по доске с "туманом войны": видимые клетки как есть, в невидимых -
+     * фигуры противника там, где их видели последний раз. Если такая позиция невозможна, невидимые
+     * клетки заполняет PositionSampler. Обновляет память бота.
+     * @return nullopt, если fow_fen не разбирается
+     */
+    std::optional<Chessboard> GuessPosition(std::string_view fow_fen);
+private:
+    bool IsEnemy(char c) const;
+    // FEN с видимыми клетками из frame и запомненными фигурами в остальных
+    std::string MemoryFen(std::string_view frame, std::string_view tail, std::string_view castling,
+                          size_t castling_end) const;
+    // Случайная позиция, согласованная с обзором и запомненным составом фигур противника
+    std::optional<Chessboard> SamplePosition(std::string_view fow_fen);
+
+    Color _color;
+    std::chrono::milliseconds _budget;
+    // Последние увиденные фигуры противника по клеткам, '+' - фигуры нет; сначала - начальная расстановка
+    FogFrame _memory;
+    // Состояние SplitMix64 для SamplePosition
+    uint64_t _rng_state;
+};
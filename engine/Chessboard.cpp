@@ -1,823 +1,1147 @@
 #include "Chessboard.h"
 
-#include <map>
-#include <sstream>
 #include <algorithm>
-#include <set>
-
-std::map<char, ColoredFigure> char_to_figure = {
-        {'P', {Color::WHITE, Figure::PAWN}},
-        {'N', {Color::WHITE, Figure::KNIGHT}},
-        {'B', {Color::WHITE, Figure::BISHOP}},
-        {'R', {Color::WHITE, Figure::ROOK}},
-        {'Q', {Color::WHITE, Figure::QUEEN}},
-        {'K', {Color::WHITE, Figure::KING}},
-        {'p', {Color::BLACK, Figure::PAWN}},
-        {'n', {Color::BLACK, Figure::KNIGHT}},
-        {'b', {Color::BLACK, Figure::BISHOP}},
-        {'r', {Color::BLACK, Figure::ROOK}},
-        {'q', {Color::BLACK, Figure::QUEEN}},
-        {'k', {Color::BLACK, Figure::KING}},
-};
-
-std::unordered_map<ColoredFigure, char, ColoredFigureHash> figure_to_char = {
-        {{Color::WHITE, Figure::PAWN},   'P'},
-        {{Color::WHITE, Figure::KNIGHT}, 'N'},
-        {{Color::WHITE, Figure::BISHOP}, 'B'},
-        {{Color::WHITE, Figure::ROOK},   'R'},
-        {{Color::WHITE, Figure::QUEEN},  'Q'},
-        {{Color::WHITE, Figure::KING},   'K'},
-        {{Color::BLACK, Figure::PAWN},   'p'},
-        {{Color::BLACK, Figure::KNIGHT}, 'n'},
-        {{Color::BLACK, Figure::BISHOP}, 'b'},
-        {{Color::BLACK, Figure::ROOK},   'r'},
-        {{Color::BLACK, Figure::QUEEN},  'q'},
-        {{Color::BLACK, Figure::KING},   'k'}
-};
-
-
-Chessboard::Chessboard(const std::string &fen) {
-    // Пример нотации (стартовая позиция): rnbqkbnr/pppppppp/9/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1
-    std::istringstream notation_stream(fen);
-    std::string buffer;
-
-    // Считывание фигур на поле
-    std::getline(notation_stream, buffer, ' ');
-    int row = 7;
+#include <cctype>
+#include <charconv>
+#include <stdexcept>
 
-    std::istringstream figures_stream(buffer);
-    while (row >= 0) {
-        std::getline(figures_stream, buffer, '/');
-        int col = 0;
-        for (auto c : buffer) {
-            auto it = char_to_figure.find(c);
-            if (it != char_to_figure.end()) {
-                _table[row][col++] = it->second;
-            } else if ('1' <= c && c <= '8') {
-                col += c - '1';
-            }
-        }
-        --row;
-    }
-
-    // Считывание игрока, обладающего первым ходом
-    std::getline(notation_stream, buffer, ' ');
-    if (buffer == "w") {
-        _current_turn = Color::WHITE;
-    } else if (buffer == "b") {
-        _current_turn = Color::BLACK;
-    }
-
-    // Считывание права на рокировки обоих игроков
-    std::getline(notation_stream, buffer, ' ');
-    _white_can_kingside_castling = false;
-    _white_can_queenside_castling = false;
-    _black_can_kingside_castling = false;
-    _black_can_queenside_castling = false;
-    if (buffer != "-") {
-        for (auto c : buffer) {
-            switch (c) {
-                case 'K':
-                    _white_can_kingside_castling = true;
-                    break;
-                case 'Q':
-                    _white_can_queenside_castling = true;
-                    break;
-                case 'k':
-                    _black_can_kingside_castling = true;
-                    break;
-                case 'q':
-                    _black_can_queenside_castling = true;
-                    break;
-            }
-        }
-    }
+namespace {
 
-    // Считывание поля, по которому можно произвести взятие на проходе
-    std::getline(notation_stream, buffer, ' ');
-    if (buffer != "-") {
-        _en_passant_square.emplace(buffer[1] - '1', buffer[1] - 'A');
-    }
-
-    // Считывание количества ходов без взятий
-    notation_stream >> _moves_without_capture_counter;
-
-    // Считывание номера хода
-    notation_stream >> _moves_counter;
+    // Буквы фигур в FEN: [цвет][фигура], фигура NOTHING не используется
+    constexpr char figure_chars[2][8] = {" PNBRQK", " pnbrqk"};
 
-    _was_triple_repetition = false;
-    _position_repetitions.emplace(_table, 2);
+    char FigureChar(Color color, Figure figure) {
+        return figure_chars[static_cast<int>(color)][static_cast<int>(figure)];
+    }
 
-    result_cache = Result();
-}
+    bool CharToFigure(char c, Color& color, Figure& figure) {
+        switch (std::tolower(static_cast<unsigned char>(c))) {
+            case 'p':
+                figure = Figure::PAWN;
+                break;
+            case 'n':
+                figure = Figure::KNIGHT;
+                break;
+            case 'b':
+                figure = Figure::BISHOP;
+                break;
+            case 'r':
+                figure = Figure::ROOK;
+                break;
+            case 'q':
+                figure = Figure::QUEEN;
+                break;
+            case 'k':
+                figure = Figure::KING;
+                break;
+            default:
+                return false;
+        }
+        color = std::isupper(static_cast<unsigned char>(c)) ? Color::WHITE : Color::BLACK;
+        return true;
+    }
 
+    char* WriteNumber(char* out, int value) {
+        // Буфер всегда достаточного размера, поэтому результат не проверяется
+        return std::to_chars(out, out + 11, value).ptr;
+    }
 
-const Table& Chessboard::GetTable() const {
-    return _table;
 }
 
 
-bool Chessboard::MakeMove(Coords from, Coords to, Figure figure_to_place) {
-    ColoredFigure &figure_to_move = _table[from.GetRow()][from.GetCol()];
-
-    if (figure_to_move.color != _current_turn) {
-        return false;
+Chessboard::Chessboard(std::string_view fen)
+        : _version(0), _hash(0), _history{}, _history_length(0), _history_valid(0), _pieces{}, _occupied{}, _figures{} {
+    FenError error{};
+    if (!SetFen(fen, &error)) {
+        throw std::invalid_argument("Invalid FEN at position " + std::to_string(error.position) + ": " +
+                                    error.message);
     }
 
-    ColoredFigure &figure_to_eat = _table[to.GetRow()][to.GetCol()];
-    bool is_capture = figure_to_eat.figure != Figure::NOTHING || figure_to_move.figure == Figure::PAWN;
+    _version = 0;
+    _result_version = ~_version;
+    _legal_version = ~_version;
+}
 
-    // проверить ход фигуры
-    auto possible_moves = GetMoves(from, true);
-    if (std::find(possible_moves.begin(), possible_moves.end(), to) == possible_moves.end()) {
-        return false;
-    }
 
-    if (figure_to_move.figure == Figure::PAWN && to == _en_passant_square) {
-        if (figure_to_move.color == Color::WHITE) {
-            _table[to.GetRow() - 1][to.GetCol()].figure = Figure::NOTHING;
-        } else if (figure_to_move.color == Color::BLACK) {
-            _table[to.GetRow() + 1][to.GetCol()].figure = Figure::NOTHING;
+bool Chessboard::SetFen(std::string_view fen, FenError* error) {
+    // Пример нотации (стартовая позиция): rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1
+    size_t pos = 0;
+    auto fail = [&pos, error](const char* message) {
+        if (error != nullptr) {
+            *error = {pos, message};
         }
-    } else if (figure_to_move.figure == Figure::KING && abs(from.GetCol() - to.GetCol()) == 2) {
-        if (to.GetCol() > from.GetCol()) {
-            std::swap(_table[from.GetRow()][7], _table[from.GetRow()][5]);
-        } else {
-            std::swap(_table[from.GetRow()][0], _table[from.GetRow()][3]);
+        return false;
+    };
+    auto skip_spaces = [&pos, fen]() {
+        bool skipped = pos < fen.size() && fen[pos] == ' ';
+        while (pos < fen.size() && fen[pos] == ' ') {
+            ++pos;
         }
-    }
-    figure_to_eat = figure_to_move;
-    figure_to_move.figure = Figure::NOTHING;
+        return skipped || pos == fen.size();
+    };
+    auto read_number = [&pos, fen](int& value) {
+        size_t start = pos;
+        value = 0;
+        while (pos < fen.size() && std::isdigit(static_cast<unsigned char>(fen[pos])) && pos - start < 9) {
+            value = value * 10 + (fen[pos++] - '0');
+        }
+        return pos > start && (pos == fen.size() || fen[pos] == ' ');
+    };
 
-    if (figure_to_eat.figure == Figure::KING) {
-        if (_current_turn == Color::WHITE) {
-            _white_can_kingside_castling = false;
-            _white_can_queenside_castling = false;
+    // Расстановка фигур, начиная с 8-й горизонтали
+    std::array<Figure, 64> figures{};
+    Bitboard black = 0;
+    int row = 7;
+    int col = 0;
+    for (; pos < fen.size() && fen[pos] != ' '; ++pos) {
+        char c = fen[pos];
+        Color color;
+        Figure figure;
+        if (c == '/') {
+            if (col != 8 || row == 0) {
+                return fail("each rank must describe exactly 8 squares");
+            }
+            --row;
+            col = 0;
+        } else if ('1' <= c && c <= '8') {
+            col += c - '0';
+            if (col > 8) {
+                return fail("rank is longer than 8 squares");
+            }
+        } else if (CharToFigure(c, color, figure)) {
+            if (col >= 8) {
+                return fail("rank is longer than 8 squares");
+            }
+            figures[row * 8 + col] = figure;
+            black |= color == Color::BLACK ? SquareBB(row * 8 + col) : 0;
+            ++col;
         } else {
-            _black_can_kingside_castling = false;
-            _black_can_queenside_castling = false;
+            return fail("unexpected character in piece placement");
         }
-    } else if (to.GetRow() == 0 && to.GetCol() == 0) {
-        _white_can_queenside_castling = false;
-    } else if (to.GetRow() == 0 && to.GetCol() == 7) {
-        _white_can_kingside_castling = false;
-    } else if (to.GetRow() == 7 && to.GetCol() == 0) {
-        _black_can_queenside_castling = false;
-    } else if (to.GetRow() == 7 && to.GetCol() == 7) {
-        _black_can_kingside_castling = false;
     }
-
-    // Обработка взятия на проходе
-    if (figure_to_eat.figure == Figure::PAWN && abs(from.GetRow() - to.GetRow()) == 2) {
-        _en_passant_square.emplace((from.GetRow() + to.GetRow()) / 2, from.GetCol());
-    } else {
-        _en_passant_square.reset();
+    if (row != 0 || col != 8) {
+        return fail("piece placement must describe 8 ranks of 8 squares");
     }
 
-    // Обработка прохода пешки до последней горизонтали
-    if (figure_to_eat.figure == Figure::PAWN && (to.GetRow() == 0 || to.GetRow() == 7)) {
-        figure_to_eat.figure = figure_to_place;
+    // Игрок, обладающий первым ходом
+    skip_spaces();
+    if (pos == fen.size() || (fen[pos] != 'w' && fen[pos] != 'b')) {
+        return fail("side to move must be 'w' or 'b'");
+    }
+    Color current_turn = fen[pos++] == 'w' ? Color::WHITE : Color::BLACK;
+    if (!skip_spaces()) {
+        return fail("expected space after side to move");
     }
 
-    // увеличить счетчики ходов и передать ход другому игроку
-    _current_turn = (_current_turn == Color::WHITE) ? Color::BLACK : Color::WHITE;
-    if (is_capture) {
-        _moves_without_capture_counter = 0;
-        _position_repetitions.clear();
-        _position_repetitions.emplace(_table, 1);
+    // Права на рокировки обоих игроков
+    int castling_rights = 0;
+    if (pos < fen.size() && fen[pos] == '-') {
+        ++pos;
     } else {
-        ++_moves_without_capture_counter;
-        auto it = _position_repetitions.find(_table);
-        if (it != _position_repetitions.end()) {
-            if (it->second == 3) {
-                _was_triple_repetition = true;
-            } else {
-                ++it->second;
+        for (; pos < fen.size() && fen[pos] != ' '; ++pos) {
+            const char* rights = "KQkq";
+            const char* right = std::char_traits<char>::find(rights, 4, fen[pos]);
+            if (right == nullptr) {
+                return fail("castling rights must be '-' or a combination of 'KQkq'");
             }
-        } else {
-            _position_repetitions.emplace(_table, 2);
+            castling_rights |= 1 << (right - rights);
         }
     }
-    ++_moves_counter;
+    if (!skip_spaces()) {
+        return fail("expected space after castling rights");
+    }
+
+    // Поле, по которому можно произвести взятие на проходе
+    std::optional<Coords> en_passant_square;
+    if (pos < fen.size() && fen[pos] == '-') {
+        ++pos;
+    } else if (pos + 1 < fen.size()) {
+        Coords en_passant(fen[pos + 1] - '1', std::toupper(static_cast<unsigned char>(fen[pos])) - 'A');
+        if (!IsOnBoard(en_passant) || (en_passant.GetRow() != 2 && en_passant.GetRow() != 5)) {
+            return fail("en passant square must be '-' or a square on rank 3 or 6");
+        }
+        en_passant_square.emplace(en_passant);
+        pos += 2;
+    }
+    if (!skip_spaces()) {
+        return fail("expected space after en passant square");
+    }
+
+    // Количество ходов без взятий и номер хода могут отсутствовать
+    int moves_without_capture_counter = 0;
+    int moves_counter = 1;
+    if (pos < fen.size() && !read_number(moves_without_capture_counter)) {
+        return fail("halfmove clock must be a number");
+    }
+    skip_spaces();
+    if (pos < fen.size() && !read_number(moves_counter)) {
+        return fail("move number must be a number");
+    }
+    skip_spaces();
+    if (pos != fen.size()) {
+        return fail("unexpected characters after FEN");
+    }
 
-    result_cache = Result();
+    // Разбор успешен - заменяем позицию целиком
+    SetPosition(figures, black, current_turn, castling_rights, en_passant_square, moves_without_capture_counter,
+                moves_counter);
     return true;
 }
 
 
-enum Color Chessboard::GetCurrentTurn() {
-    return _current_turn;
+PackedPosition Chessboard::Pack() const {
+    PackedPosition packed{};
+    Bitboard black = _occupied[static_cast<int>(Color::BLACK)];
+    for (int square = 0; square < 64; ++square) {
+        uint8_t code = static_cast<uint8_t>(_figures[square]) | ((black & SquareBB(square)) ? 8 : 0);
+        packed.squares[square / 2] |= code << (square % 2 * 4);
+    }
+
+    packed.flags = static_cast<uint8_t>((_current_turn == Color::BLACK ? 1 : 0) | CastlingRights() << 1);
+    packed.en_passant = _en_passant_square.has_value()
+            ? static_cast<uint8_t>(SquareOf(*_en_passant_square))
+            : PackedPosition::NO_EN_PASSANT;
+
+    auto write_counter = [](std::array<uint8_t, 2>& out, int value) {
+        value = std::clamp(value, 0, 0xFFFF);
+        out[0] = static_cast<uint8_t>(value & 0xFF);
+        out[1] = static_cast<uint8_t>(value >> 8);
+    };
+    write_counter(packed.moves_without_capture, _moves_without_capture_counter);
+    write_counter(packed.moves_counter, _moves_counter);
+
+    return packed;
 }
 
-bool Chessboard::IsCheck(Color to_player) {
-    Color enemy_color = (to_player == Color::WHITE) ? Color::BLACK : Color::WHITE;
-    auto protected_fields = ProtectedFields(enemy_color);
 
-    for (int i = 0; i < 8; ++i) {
-        for (int j = 0; j < 8; ++j) {
-            if (_table[i][j].figure == Figure::KING && _table[i][j].color == to_player) {
-                return !protected_fields[i][j].empty();
-            }
+bool Chessboard::Unpack(const PackedPosition& packed) {
+    std::array<Figure, 64> figures{};
+    Bitboard black = 0;
+    for (int square = 0; square < 64; ++square) {
+        uint8_t code = (packed.squares[square / 2] >> (square % 2 * 4)) & 0xF;
+        uint8_t figure = code & 7;
+        // Пустая клетка кодируется только нулем, иначе у позиции было бы два представления
+        if (figure > static_cast<uint8_t>(Figure::KING) || (figure == 0 && code != 0)) {
+            return false;
         }
+        figures[square] = static_cast<Figure>(figure);
+        black |= (code & 8) ? SquareBB(square) : 0;
     }
 
-    return false;
-}
+    if (packed.flags >> 5) {
+        return false;
+    }
 
+    std::optional<Coords> en_passant_square;
+    if (packed.en_passant != PackedPosition::NO_EN_PASSANT) {
+        int row = packed.en_passant / 8;
+        if (packed.en_passant >= 64 || (row != 2 && row != 5)) {
+            return false;
+        }
+        en_passant_square = CoordsOf(packed.en_passant);
+    }
 
-bool Chessboard::NoCheckAfterMove(Coords from, Coords to, Color to_player) {
-    ColoredFigure figure_on_from = _table[from.GetRow()][from.GetCol()];
-    ColoredFigure figure_on_to = _table[to.GetRow()][to.GetCol()];
+    SetPosition(figures, black, (packed.flags & 1) ? Color::BLACK : Color::WHITE, packed.flags >> 1,
+                en_passant_square, packed.moves_without_capture[0] | packed.moves_without_capture[1] << 8,
+                packed.moves_counter[0] | packed.moves_counter[1] << 8);
+    return true;
+}
 
-    _table[from.GetRow()][from.GetCol()].figure = Figure::NOTHING;
-    _table[to.GetRow()][to.GetCol()] = figure_on_from;
 
-    bool no_check = !IsCheck(to_player);
+void Chessboard::SetPosition(const std::array<Figure, 64>& figures, Bitboard black, Color current_turn,
+                             int castling_rights, std::optional<Coords> en_passant_square,
+                             int moves_without_capture_counter, int moves_counter) {
+    _pieces = {};
+    _occupied = {};
+    _figures.fill(Figure::NOTHING);
+    _hash = 0;
+    for (int square = 0; square < 64; ++square) {
+        if (figures[square] != Figure::NOTHING) {
+            PutFigure((black & SquareBB(square)) ? Color::BLACK : Color::WHITE, figures[square], square);
+        }
+    }
 
-    _table[from.GetRow()][from.GetCol()] = figure_on_from;
-    _table[to.GetRow()][to.GetCol()] = figure_on_to;
+    _current_turn = current_turn;
+    SetCastlingRights(castling_rights);
+    _en_passant_square = en_passant_square;
+    _moves_without_capture_counter = moves_without_capture_counter;
+    _moves_counter = moves_counter;
 
-    return no_check;
+    _was_triple_repetition = false;
+    _history_length = 0;
+    _history_valid = 0;
+    _undo_stack.clear();
+    _hash ^= StateKey();
+    PushHistory();
+
+    ++_version;
+    _result_version = ~_version;
+    _legal_version = ~_version;
 }
 
 
-std::array<std::array<std::vector<Coords>, 8>, 8> Chessboard::AllPossibleMoves(Color for_player) {
-    std::array<std::array<std::vector<Coords>, 8>, 8> possible_moves;
-    for (int i = 0; i < 8; ++i) {
-        for (int j = 0; j < 8; ++j) {
-            if (_table[i][j].color == for_player) {
-                possible_moves[i][j] = GetMoves(Coords(i, j), true);
+size_t Chessboard::WriteFen(char* buffer, size_t size) const {
+    if (size < FEN_BUFFER_SIZE) {
+        return 0;
+    }
+
+    char* out = buffer;
+    for (int row = 7; row >= 0; --row) {
+        int empty = 0;
+        for (int col = 0; col < 8; ++col) {
+            int square = row * 8 + col;
+            if (_figures[square] == Figure::NOTHING) {
+                ++empty;
+                continue;
             }
+            if (empty) {
+                *out++ = static_cast<char>('0' + empty);
+                empty = 0;
+            }
+            *out++ = FigureChar(ColorAt(square), _figures[square]);
+        }
+        if (empty) {
+            *out++ = static_cast<char>('0' + empty);
+        }
+        if (row) {
+            *out++ = '/';
         }
     }
 
-    return possible_moves;
+    *out++ = ' ';
+    *out++ = _current_turn == Color::WHITE ? 'w' : 'b';
+    *out++ = ' ';
+    char* castling = out;
+    if (_white_can_kingside_castling)
+        *out++ = 'K';
+    if (_white_can_queenside_castling)
+        *out++ = 'Q';
+    if (_black_can_kingside_castling)
+        *out++ = 'k';
+    if (_black_can_queenside_castling)
+        *out++ = 'q';
+    if (out == castling)
+        *out++ = '-';
+    *out++ = ' ';
+    if (_en_passant_square.has_value()) {
+        *out++ = static_cast<char>('a' + _en_passant_square->GetCol());
+        *out++ = static_cast<char>('1' + _en_passant_square->GetRow());
+    } else {
+        *out++ = '-';
+    }
+    *out++ = ' ';
+    out = WriteNumber(out, _moves_without_capture_counter);
+    *out++ = ' ';
+    out = WriteNumber(out, _moves_counter);
+
+    return out - buffer;
 }
 
 
-std::array<std::array<std::vector<Coords>, 8>, 8> Chessboard::ProtectedFields(Color by_player) {
-    std::array<std::array<std::vector<Coords>, 8>, 8> protected_fields;
-    for (int i = 0; i < 8; ++i) {
-        for (int j = 0; j < 8; ++j) {
-            if (_table[i][j].color == by_player) {
-                auto v = GetMoves(Coords(i, j), false);
-                for (auto cs : v) {
-                    protected_fields[cs.GetRow()][cs.GetCol()].emplace_back(i, j);
-                }
-            }
-        }
+std::string Chessboard::GetFen() const {
+    char buffer[FEN_BUFFER_SIZE];
+    return std::string(buffer, WriteFen(buffer, sizeof(buffer)));
+}
+
+
+Table Chessboard::GetTable() const {
+    Table table;
+    for (int square = 0; square < 64; ++square) {
+        table[square / 8][square % 8] = _figures[square] == Figure::NOTHING
+                ? ColoredFigure()
+                : ColoredFigure(ColorAt(square), _figures[square]);
     }
 
-    return protected_fields;
+    return table;
 }
 
 
-/**
- * TODO Реализовать метод
- */
-std::string Chessboard::GetFOWFen(Color for_player) {
-    // Пример нотации (стартовая позиция): rnbqkbnr/pppppppp/9/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1
-    //                                   :
-    std::ostringstream stream;
-    std::array<std::array<bool, 8>, 8> mask;
-    for (int i = 0; i < 8; ++i) {
-        for (int j = 0; j < 8; ++j) {
-            mask[i][j] = false;
-        }
+bool Chessboard::MakeMove(Coords from, Coords to, Figure figure_to_place) {
+    if (!IsOnBoard(from) || !IsOnBoard(to)) {
+        return false;
     }
 
-    for (int i = 0; i < 8; ++i) {
-        for (int j = 0; j < 8; ++j) {
-            if (_table[i][j].figure != Figure::NOTHING && _table[i][j].color == for_player) {
-                mask[i][j] = true;
-                for (int i0 = std::max(0, i - 1); i0 <= std::min(7, i + 1); ++i0)
-                    for (int j0 = std::max(0, j - 1); j0 <= std::min(7, j + 1); ++j0)
-                        mask[i0][j0] = true;
-            }
-        }
+    int from_square = SquareOf(from);
+    int to_square = SquareOf(to);
+    if (!(_occupied[static_cast<int>(_current_turn)] & SquareBB(from_square))) {
+        return false;
     }
 
+    // проверить ход фигуры по кешу легальных ходов
+    UpdateLegalMoves();
+    if (!(_legal_from & SquareBB(from_square)) || !(_legal_targets[from_square] & SquareBB(to_square))) {
+        return false;
+    }
 
-    for (int i = 0; i < 8; ++i) {
-        for (int j = 0; j < 8; ++j) {
-            if (_table[i][j].color == for_player) {
-                auto v = GetMoves(Coords(i, j), false);
-                for (auto cs : v) {
-                    mask[cs.GetRow()][cs.GetCol()] = true;
-                }
-                if (_table[i][j].figure == Figure::PAWN && for_player == Color::WHITE && i == 1) {
-                    mask[i + 2][j] = true;
-                } else if (_table[i][j].figure == Figure::PAWN && for_player == Color::BLACK && i == 6) {
-                    mask[i - 2][j] = true;
-                }
-            }
-        }
+    // по умолчанию пешка превращается в ферзя
+    if (figure_to_place == Figure::NOTHING || figure_to_place == Figure::PAWN || figure_to_place == Figure::KING) {
+        figure_to_place = Figure::QUEEN;
     }
 
+    MakeMoveUnchecked({static_cast<uint8_t>(from_square), static_cast<uint8_t>(to_square), figure_to_place});
+    return true;
+}
 
-    auto protected_fields = ProtectedFields(for_player);
-    for (int i = 0; i < 8; ++i) {
-        for (int j = 0; j < 8; ++j) {
-            if (!protected_fields[i][j].empty()) {
-                mask[i][j] = true;
-            }
+
+bool Chessboard::MakeMove(Move move) {
+    return MakeMove(CoordsOf(move.from), CoordsOf(move.to), move.promotion);
+}
+
+
+void Chessboard::MakeMoveUnchecked(const Move& move) {
+    int from_square = move.from;
+    int to_square = move.to;
+    Figure figure_to_move = _figures[from_square];
+    bool is_en_passant = figure_to_move == Figure::PAWN && _en_passant_square.has_value() &&
+                         SquareOf(*_en_passant_square) == to_square;
+    bool is_capture = _figures[to_square] != Figure::NOTHING || figure_to_move == Figure::PAWN;
+
+    _undo_stack.push_back({move, figure_to_move, is_en_passant ? Figure::PAWN : _figures[to_square],
+                           static_cast<uint8_t>(CastlingRights()),
+                           static_cast<int8_t>(_en_passant_square.has_value() ? SquareOf(*_en_passant_square) : -1),
+                           _was_triple_repetition, _moves_without_capture_counter, _hash});
+
+    // ключи очереди хода, рокировок и взятия на проходе снимаются до хода и добавляются после
+    _hash ^= StateKey();
+
+    if (is_en_passant) {
+        RemoveFigure(_current_turn == Color::WHITE ? to_square - 8 : to_square + 8);
+    } else if (figure_to_move == Figure::KING && abs(from_square - to_square) == 2) {
+        int row = from_square / 8 * 8;
+        if (to_square > from_square) {
+            MoveFigure(row + 7, row + 5);
+        } else {
+            MoveFigure(row, row + 3);
         }
     }
+    if (_figures[to_square] != Figure::NOTHING) {
+        RemoveFigure(to_square);
+    }
+    MoveFigure(from_square, to_square);
 
-    Coords king_pos;
-    for (int i = 0; i < 8; ++i) {
-        for (int j = 0; j < 8; ++j) {
-            if (_table[i][j].figure == Figure::KING && _table[i][j].color == for_player) {
-                king_pos.SetRow(i); king_pos.SetCol(j);
-            }
+    // Право на рокировку теряется при ходе короля, а также при ходе ладьи с начального поля или ее взятии
+    if (figure_to_move == Figure::KING) {
+        if (_current_turn == Color::WHITE) {
+            _white_can_kingside_castling = false;
+            _white_can_queenside_castling = false;
+        } else {
+            _black_can_kingside_castling = false;
+            _black_can_queenside_castling = false;
         }
     }
-
-    Color enemy_color = (for_player == Color::WHITE ? Color::BLACK : Color::WHITE);
-    for (int i = 0; i < 8; ++i) {
-        for (int j = 0; j < 8; ++j) {
-            if ((_table[i][j].figure == Figure::ROOK || _table[i][j].figure == Figure::QUEEN) && _table[i][j].color != for_player) {
-                if (i == king_pos.GetRow() || j == king_pos.GetCol()) {
-                    mask[i][j] = true;
-                }
-            }
+    for (int square : {from_square, to_square}) {
+        if (square == 0) {
+            _white_can_queenside_castling = false;
+        } else if (square == 7) {
+            _white_can_kingside_castling = false;
+        } else if (square == 56) {
+            _black_can_queenside_castling = false;
+        } else if (square == 63) {
+            _black_can_kingside_castling = false;
         }
     }
 
-    auto enemy_protected_fields = ProtectedFields(enemy_color);
-    for (auto cds : enemy_protected_fields[king_pos.GetRow()][king_pos.GetCol()]) {
-        mask[cds.GetRow()][cds.GetCol()] = true;
+    // Обработка взятия на проходе
+    if (figure_to_move == Figure::PAWN && abs(from_square - to_square) == 16) {
+        _en_passant_square.emplace(CoordsOf((from_square + to_square) / 2));
+    } else {
+        _en_passant_square.reset();
     }
 
-    auto castling_moves = GetCastlingMoves(king_pos);
-    for (auto cds : castling_moves) {
-        for (auto enemy_figure_pos : enemy_protected_fields[cds.GetRow()][cds.GetCol()]) {
-            mask[enemy_figure_pos.GetRow()][enemy_figure_pos.GetCol()] = true;
-        }
+    // Обработка прохода пешки до последней горизонтали
+    if (figure_to_move == Figure::PAWN && ((RANK_1 | RANK_8) & SquareBB(to_square))) {
+        RemoveFigure(to_square);
+        PutFigure(_current_turn, move.promotion, to_square);
     }
 
-    for (int i = 0; i < 8; ++i) {
-        for (int j = 0; j < 8; ++j) {
-            if ((_table[i][j].figure == Figure::BISHOP || _table[i][j].figure == Figure::QUEEN) && _table[i][j].color != for_player) {
-                if ((i - j == king_pos.GetRow() - king_pos.GetCol()) || (i + j == king_pos.GetRow() + king_pos.GetCol())) {
-                    mask[i][j] = true;
-                }
-            }
+    // увеличить счетчики ходов и передать ход другому игроку
+    _current_turn = Opposite(_current_turn);
+    _hash ^= StateKey();
+    PushHistory();
+    if (is_capture) {
+        _moves_without_capture_counter = 0;
+    } else {
+        ++_moves_without_capture_counter;
+        if (CountRepetitions() >= 3) {
+            _was_triple_repetition = true;
         }
     }
+    ++_moves_counter;
+    ++_version;
+}
 
-    // + if visible, - if not visible
-    for (int i = 0; i < 8; ++i) {
-        for (int j = 0; j < 8; ++j) {
-            if (!mask[i][j]) {
-                stream << '-';
-            } else if (_table[i][j].figure == Figure::NOTHING) {
-                stream << '+';
-            } else {
-                stream << figure_to_char.at(_table[i][j]);
-            }
-        }
+
+void Chessboard::GetPlayedMoves(std::vector<Move>& moves) const {
+    moves.clear();
+    moves.reserve(_undo_stack.size());
+    for (const UndoRecord& record : _undo_stack) {
+        moves.push_back(record.move);
     }
+}
 
-    stream << ' ';
-    stream << (_current_turn == Color::WHITE ? 'w' : 'b');
-    stream << ' ';
-    if (_white_can_kingside_castling)
-        stream << 'K';
-    if (_white_can_queenside_castling)
-        stream << 'Q';
-    if (_black_can_kingside_castling)
-        stream << 'k';
-    if (_black_can_queenside_castling)
-        stream << 'q';
-    stream << ' ';
-    if (_en_passant_square.has_value())
-        stream << static_cast<char>('A' + _en_passant_square->GetCol())
-               << static_cast<char>('1' + _en_passant_square->GetRow());
-    else
-        stream << '-';
-    stream << ' ';
-    stream << _moves_without_capture_counter;
-    stream << ' ';
-    stream << _moves_counter;
+size_t Chessboard::GetPlayedMoveCount() const {
+    return _undo_stack.size();
+}
+
+void Chessboard::GetSnapshot(PackedPosition& start, std::vector<Move>& moves) const {
+    // После троекратного повторения нужна вся история, иначе флаг ничьей потеряется
+    size_t tail = _undo_stack.size();
+    if (!_was_triple_repetition) {
+        tail = std::min(tail, static_cast<size_t>(std::max(_moves_without_capture_counter, 1)));
+    }
+
+    Chessboard board(*this);
+    for (size_t i = 0; i < tail; ++i) {
+        board.UnmakeMove();
+    }
+    start = board.Pack();
 
-    return stream.str();
+    moves.clear();
+    moves.reserve(tail);
+    for (size_t i = _undo_stack.size() - tail; i < _undo_stack.size(); ++i) {
+        moves.push_back(_undo_stack[i].move);
+    }
 }
 
+bool Chessboard::UnmakeMove() {
+    if (_undo_stack.empty()) {
+        return false;
+    }
 
-Result Chessboard::Result() {
-    if (IsMate()) {
-        if (_current_turn == Color::WHITE) {
-            return Result::BLACK_WIN;
+    const UndoRecord record = _undo_stack.back();
+    _undo_stack.pop_back();
+
+    _current_turn = Opposite(_current_turn);
+    int from_square = record.move.from;
+    int to_square = record.move.to;
+
+    if (_figures[to_square] != record.moved) {
+        RemoveFigure(to_square);
+        PutFigure(_current_turn, record.moved, to_square);
+    }
+    MoveFigure(to_square, from_square);
+
+    if (record.captured != Figure::NOTHING) {
+        int captured_square = to_square;
+        if (record.en_passant == to_square && record.moved == Figure::PAWN) {
+            captured_square = _current_turn == Color::WHITE ? to_square - 8 : to_square + 8;
+        }
+        PutFigure(Opposite(_current_turn), record.captured, captured_square);
+    } else if (record.moved == Figure::KING && abs(from_square - to_square) == 2) {
+        int row = from_square / 8 * 8;
+        if (to_square > from_square) {
+            MoveFigure(row + 5, row + 7);
         } else {
-            return Result::WHITE_WIN;
+            MoveFigure(row + 3, row);
         }
-    } else if (IsStaleMate() || IsFiftyMovesWithoutCapture() || IsTripleRepetition()) {
-        return Result::DRAW;
     }
 
-    return Result::IN_PROGRESS;
+    SetCastlingRights(record.castling_rights);
+    if (record.en_passant >= 0) {
+        _en_passant_square.emplace(CoordsOf(record.en_passant));
+    } else {
+        _en_passant_square.reset();
+    }
+    _was_triple_repetition = record.was_triple_repetition;
+    _moves_without_capture_counter = record.moves_without_capture;
+    _hash = record.hash;
+    --_history_length;
+    _history_valid = std::max(_history_valid - 1, 0);
+    --_moves_counter;
+    // Версия не уменьшается: после отмены хода получается новая версия позиции
+    ++_version;
+
+    return true;
 }
 
 
-size_t Chessboard::TableHash::operator()(const Table &table) const noexcept {
-    ColoredFigureHash cf_hash;
-    const size_t R = 3;
-    size_t hash = 1;
-    for (const auto &row : table) {
-        for (const auto cf : row) {
-            hash = (R * hash + cf_hash(cf));
-        }
-    }
+void Chessboard::PutFigure(Color color, Figure figure, int square) {
+    Bitboard b = SquareBB(square);
+    _hash ^= ZOBRIST.figures[static_cast<int>(color)][static_cast<int>(figure)][square];
+    _pieces[static_cast<int>(color)][static_cast<int>(figure)] |= b;
+    _occupied[static_cast<int>(color)] |= b;
+    _figures[square] = figure;
+}
+
+
+void Chessboard::RemoveFigure(int square) {
+    Bitboard b = SquareBB(square);
+    Color color = ColorAt(square);
+    _hash ^= ZOBRIST.figures[static_cast<int>(color)][static_cast<int>(_figures[square])][square];
+    _pieces[static_cast<int>(color)][static_cast<int>(_figures[square])] &= ~b;
+    _occupied[static_cast<int>(color)] &= ~b;
+    _figures[square] = Figure::NOTHING;
+}
+
+
+void Chessboard::MoveFigure(int from, int to) {
+    Color color = ColorAt(from);
+    Figure figure = _figures[from];
+    RemoveFigure(from);
+    PutFigure(color, figure, to);
+}
+
+
+Color Chessboard::ColorAt(int square) const {
+    return (_occupied[static_cast<int>(Color::BLACK)] & SquareBB(square)) ? Color::BLACK : Color::WHITE;
+}
 
-    return hash;
+
+int Chessboard::KingSquare(Color color) const {
+    Bitboard king = _pieces[static_cast<int>(color)][static_cast<int>(Figure::KING)];
+    return king ? Lsb(king) : -1;
 }
 
-std::vector<Coords> Chessboard::GetMoves(Coords figure_pos, bool only_possible) {
-    switch (_table[figure_pos.GetRow()][figure_pos.GetCol()].figure) {
+
+Bitboard Chessboard::Attacks(int square, Bitboard occupied) const {
+    switch (_figures[square]) {
         case Figure::PAWN:
-            return GetMovesPawn(figure_pos, only_possible);
+            return PawnAttacks(ColorAt(square), square);
         case Figure::KNIGHT:
-            return GetMovesKnight(figure_pos, only_possible);
+            return KnightAttacks(square);
         case Figure::BISHOP:
-            return GetMovesBishop(figure_pos, only_possible);
+            return BishopAttacks(square, occupied);
         case Figure::ROOK:
-            return GetMovesRook(figure_pos, only_possible);
+            return RookAttacks(square, occupied);
         case Figure::QUEEN:
-            return GetMovesQueen(figure_pos, only_possible);
+            return BishopAttacks(square, occupied) | RookAttacks(square, occupied);
         case Figure::KING:
-            return GetMovesKing(figure_pos, only_possible);
+            return KingAttacks(square);
         default:
-            return {};
+            return 0;
     }
 }
 
 
-std::vector<Coords> Chessboard::GetMovesPawn(Coords figure_pos, bool only_possible) {
-    int row = figure_pos.GetRow();
-    int col = figure_pos.GetCol();
-    Color figure_color = _table[row][col].color;
-    std::vector<Coords> moves;
-    if (figure_color == Color::WHITE) {
-        if (only_possible && _table[row + 1][col].figure == Figure::NOTHING) {
-            Coords coords(row + 1, col);
-            if (!only_possible || NoCheckAfterMove(figure_pos, coords, figure_color)) {
-                moves.push_back(coords);
-            }
-        }
+Bitboard Chessboard::AttackersTo(int square, Bitboard occupied) const {
+    const auto& white = _pieces[static_cast<int>(Color::WHITE)];
+    const auto& black = _pieces[static_cast<int>(Color::BLACK)];
+    auto both = [&white, &black](Figure figure) {
+        return white[static_cast<int>(figure)] | black[static_cast<int>(figure)];
+    };
 
-        if (col > 0 && (!only_possible || (_table[row + 1][col - 1].figure != Figure::NOTHING &&
-                                           _table[row + 1][col - 1].color == Color::BLACK &&
-                                           NoCheckAfterMove(figure_pos, Coords(row + 1, col - 1), figure_color)))) {
-            moves.emplace_back(row + 1, col - 1);
-        }
+    return (PawnAttacks(Color::WHITE, square) & black[static_cast<int>(Figure::PAWN)]) |
+           (PawnAttacks(Color::BLACK, square) & white[static_cast<int>(Figure::PAWN)]) |
+           (KnightAttacks(square) & both(Figure::KNIGHT)) |
+           (KingAttacks(square) & both(Figure::KING)) |
+           (BishopAttacks(square, occupied) & (both(Figure::BISHOP) | both(Figure::QUEEN))) |
+           (RookAttacks(square, occupied) & (both(Figure::ROOK) | both(Figure::QUEEN)));
+}
 
-        if (col < 7 && (!only_possible || (_table[row + 1][col + 1].figure != Figure::NOTHING &&
-                                           _table[row + 1][col + 1].color == Color::BLACK &&
-                                           NoCheckAfterMove(figure_pos, Coords(row + 1, col + 1), figure_color)))) {
-            moves.emplace_back(row + 1, col + 1);
-        }
 
-        if (only_possible && row == 1 && _table[row + 2][col].figure == Figure::NOTHING) {
-            Coords coords(row + 2, col);
-            if (!only_possible || NoCheckAfterMove(figure_pos, coords, figure_color)) {
-                moves.push_back(coords);
-            }
-        }
+Bitboard Chessboard::AttackedFields(Color by_player) const {
+    Bitboard occupied = _occupied[0] | _occupied[1];
+    Bitboard figures = _occupied[static_cast<int>(by_player)];
+    Bitboard attacked = 0;
+    while (figures) {
+        attacked |= Attacks(PopLsb(figures), occupied);
+    }
+
+    return attacked;
+}
 
-        if (only_possible && _en_passant_square.has_value() &&
-            _table[_en_passant_square->GetRow()][_en_passant_square->GetCol()].figure == Figure::NOTHING &&
-            _en_passant_square->GetRow() == row + 1 && abs(_en_passant_square->GetCol() - col) == 1) {
 
-            _table[_en_passant_square->GetRow() - 1][_en_passant_square->GetCol()].figure = Figure::NOTHING;
-            if (NoCheckAfterMove(figure_pos, _en_passant_square.value(), figure_color)) {
-                moves.push_back(_en_passant_square.value());
-            }
-            _table[_en_passant_square->GetRow() - 1][_en_passant_square->GetCol()] = ColoredFigure(Color::BLACK, Figure::PAWN);
-        }
+Chessboard::MoveMasks Chessboard::GetMoveMasks(Color for_player) const {
+    MoveMasks masks{KingSquare(for_player), 0, 0, ~Bitboard(0)};
+    if (masks.king_square < 0) {
+        return masks;
+    }
 
-    } else {
-        if (only_possible && _table[row - 1][col].figure == Figure::NOTHING) {
-            Coords coords(row - 1, col);
-            if (!only_possible || NoCheckAfterMove(figure_pos, coords, figure_color)) {
-                moves.push_back(coords);
-            }
-        }
+    int king = masks.king_square;
+    Bitboard occupied = _occupied[0] | _occupied[1];
+    Bitboard own = _occupied[static_cast<int>(for_player)];
+    Bitboard enemy = _occupied[static_cast<int>(Opposite(for_player))];
+    const auto& enemy_pieces = _pieces[static_cast<int>(Opposite(for_player))];
+
+    masks.checkers = AttackersTo(king, occupied) & enemy;
+    if (PopCount(masks.checkers) > 1) {
+        masks.check_mask = 0;
+    } else if (masks.checkers) {
+        masks.check_mask = masks.checkers | Between(king, Lsb(masks.checkers));
+    }
 
-        if (col > 0 && (!only_possible || (_table[row - 1][col - 1].figure != Figure::NOTHING &&
-                                           _table[row - 1][col - 1].color == Color::WHITE &&
-                                           NoCheckAfterMove(figure_pos, Coords(row - 1, col - 1), figure_color)))) {
-            moves.emplace_back(row - 1, col - 1);
+    // Дальнобойные фигуры противника, бьющие короля, если убрать с линии наши фигуры
+    Bitboard queens = enemy_pieces[static_cast<int>(Figure::QUEEN)];
+    Bitboard snipers = (RookAttacks(king, enemy) & (enemy_pieces[static_cast<int>(Figure::ROOK)] | queens)) |
+                       (BishopAttacks(king, enemy) & (enemy_pieces[static_cast<int>(Figure::BISHOP)] | queens));
+    while (snipers) {
+        Bitboard blockers = Between(king, PopLsb(snipers)) & occupied;
+        if (PopCount(blockers) == 1 && (blockers & own)) {
+            masks.pinned |= blockers;
         }
+    }
 
-        if (col < 7 && (!only_possible || (_table[row - 1][col + 1].figure != Figure::NOTHING &&
-                                           _table[row - 1][col + 1].color == Color::WHITE &&
-                                           NoCheckAfterMove(figure_pos, Coords(row - 1, col + 1), figure_color)))) {
-            moves.emplace_back(row - 1, col + 1);
-        }
+    return masks;
+}
 
-        if (only_possible && row == 6 && _table[row - 2][col].figure == Figure::NOTHING) {
-            Coords coords(row - 2, col);
-            if (!only_possible || NoCheckAfterMove(figure_pos, coords, figure_color)) {
-                moves.push_back(coords);
+
+Bitboard Chessboard::GetLegalMoves(int square, const MoveMasks& masks) const {
+    Bitboard targets = GetMoves(square, true);
+    if (masks.king_square < 0) {
+        return targets;
+    }
+
+    Color figure_color = ColorAt(square);
+    Bitboard enemy = _occupied[static_cast<int>(Opposite(figure_color))];
+    Bitboard occupied = _occupied[0] | _occupied[1];
+
+    if (_figures[square] == Figure::KING) {
+        // Рокировки уже проверены на битые поля, остальные ходы проверяем без короля на доске,
+        // чтобы он не закрывал собой линию атаки
+        Bitboard legal = GetCastlingMoves(square);
+        Bitboard steps = targets & ~legal;
+        Bitboard without_king = occupied ^ SquareBB(square);
+        while (steps) {
+            int target = PopLsb(steps);
+            if (!(AttackersTo(target, without_king) & enemy)) {
+                legal |= SquareBB(target);
             }
         }
+        return legal;
+    }
 
-        if (only_possible && _en_passant_square.has_value() &&
-            _table[_en_passant_square->GetRow()][_en_passant_square->GetCol()].figure == Figure::NOTHING &&
-            _en_passant_square->GetRow() == row - 1 && abs(_en_passant_square->GetCol() - col) == 1) {
+    Bitboard allowed = masks.check_mask;
+    if (masks.pinned & SquareBB(square)) {
+        allowed &= Line(masks.king_square, square);
+    }
 
-            _table[_en_passant_square->GetRow() + 1][_en_passant_square->GetCol()].figure = Figure::NOTHING;
-            if (NoCheckAfterMove(figure_pos, _en_passant_square.value(), figure_color)) {
-                moves.push_back(_en_passant_square.value());
+    if (_figures[square] == Figure::PAWN && _en_passant_square.has_value()) {
+        int en_passant = SquareOf(*_en_passant_square);
+        if (targets & SquareBB(en_passant)) {
+            // Взятие на проходе снимает с доски сразу две фигуры, поэтому проверяем
+            // атаки на короля по занятости доски после хода
+            targets &= ~SquareBB(en_passant);
+            int captured = figure_color == Color::WHITE ? en_passant - 8 : en_passant + 8;
+            Bitboard after = (occupied ^ SquareBB(square) ^ SquareBB(captured)) | SquareBB(en_passant);
+            if (!(AttackersTo(masks.king_square, after) & enemy & ~SquareBB(captured))) {
+                return (targets & allowed) | SquareBB(en_passant);
             }
-            _table[_en_passant_square->GetRow() + 1][_en_passant_square->GetCol()] = ColoredFigure(Color::WHITE, Figure::PAWN);
         }
-
     }
 
-    return moves;
+    return targets & allowed;
 }
 
 
-std::vector<Coords> Chessboard::GetMovesKnight(Coords figure_pos, bool only_possible) {
-    std::vector<Coords> moves;
+void Chessboard::UpdateLegalMoves() const {
+    if (_legal_version == _version) {
+        return;
+    }
 
-    int row = figure_pos.GetRow();
-    int col = figure_pos.GetCol();
-    Color figure_color = _table[row][col].color;
-    for (int i = 0; i < 8; ++i) {
-        for (int j = 0; j < 8; ++j) {
-            if ((abs(row - i) == 2 && abs(col - j) == 1) ||
-                (abs(row - i) == 1 && abs(col - j) == 2)) {
-                if (!only_possible || ((_table[i][j].figure == Figure::NOTHING ||
-                                        _table[i][j].color != figure_color) &&
-                                       NoCheckAfterMove(figure_pos, Coords(i, j), figure_color))) {
-                    moves.emplace_back(i, j);
-                }
-            }
+    MoveMasks masks = GetMoveMasks(_current_turn);
+    _legal_checkers = masks.checkers;
+    _legal_from = 0;
+    Bitboard figures = _occupied[static_cast<int>(_current_turn)];
+    while (figures) {
+        int from = PopLsb(figures);
+        _legal_targets[from] = GetLegalMoves(from, masks);
+        if (_legal_targets[from]) {
+            _legal_from |= SquareBB(from);
         }
     }
+    _legal_version = _version;
+}
 
-    return moves;
+
+enum Color Chessboard::GetCurrentTurn() const {
+    return _current_turn;
 }
 
+bool Chessboard::IsCheck(Color to_player) const {
+    int king_square = KingSquare(to_player);
+    if (king_square < 0) {
+        return false;
+    }
 
-std::vector<Coords> Chessboard::GetMovesBishop(Coords figure_pos, bool only_possible) {
-    std::vector<Coords> moves;
+    Bitboard occupied = _occupied[0] | _occupied[1];
+    return AttackersTo(king_square, occupied) & _occupied[static_cast<int>(Opposite(to_player))];
+}
 
-    int row = figure_pos.GetRow();
-    int col = figure_pos.GetCol();
-    Color figure_color = _table[row][col].color;
-    for (int i = row - 1, j = col - 1; i >= 0 && j >= 0; --i, --j) {
-        if (_table[i][j].figure == Figure::NOTHING) {
-            if (!only_possible || NoCheckAfterMove(figure_pos, Coords(i, j), figure_color)) {
-                moves.emplace_back(i, j);
-            }
-        } else {
-            if (!only_possible || (_table[i][j].color != figure_color &&
-                                   NoCheckAfterMove(figure_pos, Coords(i, j), figure_color))) {
-                moves.emplace_back(i, j);
-            }
-            break;
+
+void Chessboard::AllPossibleMoves(Color for_player, MoveList& moves) const {
+    moves.Clear();
+    if (for_player == _current_turn) {
+        UpdateLegalMoves();
+        Bitboard figures = _legal_from;
+        while (figures) {
+            int from = PopLsb(figures);
+            AddMoves(from, _legal_targets[from], moves);
         }
+        return;
     }
 
-    for (int i = row - 1, j = col + 1; i >= 0 && j < 8; --i, ++j) {
-        if (_table[i][j].figure == Figure::NOTHING) {
-            if (!only_possible || NoCheckAfterMove(figure_pos, Coords(i, j), figure_color)) {
-                moves.emplace_back(i, j);
-            }
-        } else {
-            if (!only_possible || (_table[i][j].color != figure_color &&
-                                   NoCheckAfterMove(figure_pos, Coords(i, j), figure_color))) {
-                moves.emplace_back(i, j);
-            }
-            break;
-        }
+    MoveMasks masks = GetMoveMasks(for_player);
+    Bitboard figures = _occupied[static_cast<int>(for_player)];
+    while (figures) {
+        int from = PopLsb(figures);
+        AddMoves(from, GetLegalMoves(from, masks), moves);
     }
+}
+
 
-    for (int i = row + 1, j = col - 1; i < 8 && j >= 0; ++i, --j) {
-        if (_table[i][j].figure == Figure::NOTHING) {
-            if (!only_possible || NoCheckAfterMove(figure_pos, Coords(i, j), figure_color)) {
-                moves.emplace_back(i, j);
+void Chessboard::AddMoves(int from, Bitboard targets, MoveList& moves) const {
+    Bitboard last_rows = RANK_1 | RANK_8;
+    bool is_pawn = _figures[from] == Figure::PAWN;
+    auto from_square = static_cast<uint8_t>(from);
+    while (targets) {
+        auto to_square = static_cast<uint8_t>(PopLsb(targets));
+        if (is_pawn && (last_rows & SquareBB(to_square))) {
+            for (Figure figure : {Figure::QUEEN, Figure::ROOK, Figure::BISHOP, Figure::KNIGHT}) {
+                moves.Add({from_square, to_square, figure});
             }
         } else {
-            if (!only_possible || (_table[i][j].color != figure_color &&
-                                   NoCheckAfterMove(figure_pos, Coords(i, j), figure_color))) {
-                moves.emplace_back(i, j);
-            }
-            break;
+            moves.Add({from_square, to_square, Figure::NOTHING});
         }
     }
+}
 
-    for (int i = row + 1, j = col + 1; i < 8 && j < 8; ++i, ++j) {
-        if (_table[i][j].figure == Figure::NOTHING) {
-            if (!only_possible || NoCheckAfterMove(figure_pos, Coords(i, j), figure_color)) {
-                moves.emplace_back(i, j);
-            }
-        } else {
-            if (!only_possible || (_table[i][j].color != figure_color &&
-                                   NoCheckAfterMove(figure_pos, Coords(i, j), figure_color))) {
-                moves.emplace_back(i, j);
-            }
-            break;
+
+void Chessboard::ProtectedFields(Color by_player, AttackSet& protected_fields) const {
+    protected_fields.Clear();
+    Bitboard occupied = _occupied[0] | _occupied[1];
+    Bitboard figures = _occupied[static_cast<int>(by_player)];
+    while (figures) {
+        int square = PopLsb(figures);
+        Bitboard targets = Attacks(square, occupied);
+        while (targets) {
+            protected_fields[PopLsb(targets)] |= SquareBB(square);
         }
     }
-
-    return moves;
 }
 
 
-std::vector<Coords> Chessboard::GetMovesRook(Coords figure_pos, bool only_possible) {
-    std::vector<Coords> moves;
+Bitboard Chessboard::VisibleFields(Color for_player) const {
+    Color enemy_color = Opposite(for_player);
+    const auto& own_pieces = _pieces[static_cast<int>(for_player)];
+    const auto& enemy_pieces = _pieces[static_cast<int>(enemy_color)];
+    Bitboard own = _occupied[static_cast<int>(for_player)];
+    Bitboard enemy = _occupied[static_cast<int>(enemy_color)];
+    Bitboard occupied = own | enemy;
 
-    int row = figure_pos.GetRow();
-    int col = figure_pos.GetCol();
-    Color figure_color = _table[row][col].color;
+    // Свои фигуры, клетки рядом с ними и все клетки, которые они бьют
+    Bitboard visible = Neighbourhood(own) | AttackedFields(for_player);
 
-    for (int i = row - 1; i >= 0; --i) {
-        int j = col;
+    // Поле двойного хода пешки с начальной позиции
+    Bitboard pawns = own_pieces[static_cast<int>(Figure::PAWN)];
+    visible |= for_player == Color::WHITE ? (pawns & RANK_2) << 16 : (pawns & RANK_7) >> 16;
 
-        if (_table[i][j].figure == Figure::NOTHING) {
-            if (!only_possible || NoCheckAfterMove(figure_pos, Coords(i, j), figure_color)) {
-                moves.emplace_back(i, j);
-            }
-        } else {
-            if (!only_possible || (_table[i][j].color != figure_color &&
-                                   NoCheckAfterMove(figure_pos, Coords(i, j), figure_color))) {
-                moves.emplace_back(i, j);
-            }
-            break;
-        }
+    int king = KingSquare(for_player);
+    if (king < 0) {
+        return visible;
     }
 
-    for (int i = row + 1; i < 8; ++i) {
-        int j = col;
+    // Фигуры противника, атакующие короля, и дальнобойные фигуры на линиях короля (даже за преградами)
+    Bitboard queens = enemy_pieces[static_cast<int>(Figure::QUEEN)];
+    visible |= AttackersTo(king, occupied) & enemy;
+    visible |= RookAttacks(king, 0) & (enemy_pieces[static_cast<int>(Figure::ROOK)] | queens);
+    visible |= BishopAttacks(king, 0) & (enemy_pieces[static_cast<int>(Figure::BISHOP)] | queens);
 
-        if (_table[i][j].figure == Figure::NOTHING) {
-            if (!only_possible || NoCheckAfterMove(figure_pos, Coords(i, j), figure_color)) {
-                moves.emplace_back(i, j);
-            }
-        } else {
-            if (!only_possible || (_table[i][j].color != figure_color &&
-                                   NoCheckAfterMove(figure_pos, Coords(i, j), figure_color))) {
-                moves.emplace_back(i, j);
-            }
-            break;
-        }
+    return visible;
+}
+
+
+std::string Chessboard::GetFOWFen(Color for_player) const {
+    char buffer[FEN_BUFFER_SIZE];
+    return std::string(buffer, WriteFOWFen(for_player, buffer, sizeof(buffer)));
+}
+
+
+size_t Chessboard::WriteFOWFen(Color for_player, char* buffer, size_t size) const {
+    // Как FEN, но клетки перечислены по одной начиная с A1: '-' - не видна, '+' - видна и пуста
+    if (size < FEN_BUFFER_SIZE) {
+        return 0;
     }
 
-    for (int j = col - 1; j >= 0; --j) {
-        int i = row;
+    EncodeFogFrame(_figures.data(), _occupied[static_cast<int>(Color::BLACK)], VisibleFields(for_player), buffer);
+    char* out = buffer + 64;
+    *out++ = ' ';
+    out = WriteFOWTail(out);
 
-        if (_table[i][j].figure == Figure::NOTHING) {
-            if (!only_possible || NoCheckAfterMove(figure_pos, Coords(i, j), figure_color)) {
-                moves.emplace_back(i, j);
-            }
-        } else {
-            if (!only_possible || (_table[i][j].color != figure_color &&
-                                   NoCheckAfterMove(figure_pos, Coords(i, j), figure_color))) {
-                moves.emplace_back(i, j);
-            }
-            break;
-        }
+    return out - buffer;
+}
+
+
+FogFrame Chessboard::GetFOWFrame(Color for_player) const {
+    FogFrame frame;
+    EncodeFogFrame(_figures.data(), _occupied[static_cast<int>(Color::BLACK)], VisibleFields(for_player), frame.data());
+
+    return frame;
+}
+
+
+std::string Chessboard::GetFOWTail() const {
+    char buffer[FEN_BUFFER_SIZE];
+    return std::string(buffer, WriteFOWTail(buffer) - buffer);
+}
+
+
+char* Chessboard::WriteFOWTail(char* out) const {
+    *out++ = _current_turn == Color::WHITE ? 'w' : 'b';
+    *out++ = ' ';
+    if (_white_can_kingside_castling)
+        *out++ = 'K';
+    if (_white_can_queenside_castling)
+        *out++ = 'Q';
+    if (_black_can_kingside_castling)
+        *out++ = 'k';
+    if (_black_can_queenside_castling)
+        *out++ = 'q';
+    *out++ = ' ';
+    if (_en_passant_square.has_value()) {
+        *out++ = static_cast<char>('A' + _en_passant_square->GetCol());
+        *out++ = static_cast<char>('1' + _en_passant_square->GetRow());
+    } else {
+        *out++ = '-';
     }
+    *out++ = ' ';
+    out = WriteNumber(out, _moves_without_capture_counter);
+    *out++ = ' ';
+    out = WriteNumber(out, _moves_counter);
+
+    return out;
+}
 
-    for (int j = col + 1; j < 8; ++j) {
-        int i = row;
 
-        if (_table[i][j].figure == Figure::NOTHING) {
-            if (!only_possible || NoCheckAfterMove(figure_pos, Coords(i, j), figure_color)) {
-                moves.emplace_back(i, j);
-            }
+Result Chessboard::Result() const {
+    if (_result_version == _version) {
+        return _result_cache;
+    }
+
+    UpdateLegalMoves();
+    if (!_legal_from) {
+        if (!_legal_checkers) {
+            _result_cache = Result::DRAW;
         } else {
-            if (!only_possible || (_table[i][j].color != figure_color &&
-                                   NoCheckAfterMove(figure_pos, Coords(i, j), figure_color))) {
-                moves.emplace_back(i, j);
-            }
-            break;
+            _result_cache = _current_turn == Color::WHITE ? Result::BLACK_WIN : Result::WHITE_WIN;
         }
+    } else if (IsFiftyMovesWithoutCapture() || IsTripleRepetition()) {
+        _result_cache = Result::DRAW;
+    } else {
+        _result_cache = Result::IN_PROGRESS;
     }
+    _result_version = _version;
 
-    return moves;
+    return _result_cache;
 }
 
 
-std::vector<Coords> Chessboard::GetMovesQueen(Coords figure_pos, bool only_possible) {
-    auto bishop_moves = GetMovesBishop(figure_pos, only_possible);
-    auto rook_moves = GetMovesRook(figure_pos, only_possible);
-    bishop_moves.insert(bishop_moves.end(), rook_moves.begin(), rook_moves.end());
+uint64_t Chessboard::GetVersion() const {
+    return _version;
+}
+
 
-    return bishop_moves;
+Bitboard Chessboard::GetPieces(Color color, Figure figure) const {
+    return _pieces[static_cast<int>(color)][static_cast<int>(figure)];
 }
 
 
-std::vector<Coords> Chessboard::GetCastlingMoves(Coords figure_pos) {
-    std::vector<Coords> moves;
+Figure Chessboard::GetFigure(int square) const {
+    return _figures[square];
+}
 
-    Color figure_color = _table[figure_pos.GetRow()][figure_pos.GetCol()].color;
-    Color enemy_color = figure_color == Color::WHITE ? Color::BLACK : Color::WHITE;
 
-    auto attacked_fields = ProtectedFields(enemy_color);
+int Chessboard::CastlingRights() const {
+    return (_white_can_kingside_castling ? 1 : 0) | (_white_can_queenside_castling ? 2 : 0) |
+           (_black_can_kingside_castling ? 4 : 0) | (_black_can_queenside_castling ? 8 : 0);
+}
 
-    bool first_alpha = true;
-    bool second_alpha = true;
 
-    if ((figure_color == Color::WHITE && _white_can_kingside_castling) ||
-        (figure_color == Color::BLACK && _black_can_kingside_castling)) {
+void Chessboard::SetCastlingRights(int rights) {
+    _white_can_kingside_castling = rights & 1;
+    _white_can_queenside_castling = rights & 2;
+    _black_can_kingside_castling = rights & 4;
+    _black_can_queenside_castling = rights & 8;
+}
 
-        int row = figure_pos.GetRow();
-        int col = figure_pos.GetCol();
 
-        for (int i = col + 1; i < 7; ++i) {
-            if (_table[row][i].figure != Figure::NOTHING) {
-                first_alpha = false;
-            }
+uint64_t Chessboard::StateKey() const {
+    uint64_t key = ZOBRIST.castling[CastlingRights()];
+    if (_current_turn == Color::BLACK) {
+        key ^= ZOBRIST.black_to_move;
+    }
+
+    // Поле взятия на проходе различает позиции, только если взятие действительно возможно
+    if (_en_passant_square.has_value()) {
+        Bitboard pawns = _pieces[static_cast<int>(_current_turn)][static_cast<int>(Figure::PAWN)];
+        if (PawnAttacks(Opposite(_current_turn), SquareOf(*_en_passant_square)) & pawns) {
+            key ^= ZOBRIST.en_passant[static_cast<int>(_en_passant_square->GetCol())];
         }
+    }
+
+    return key;
+}
+
 
-        if (first_alpha && attacked_fields[row][col].empty() && attacked_fields[row][col + 1].empty() &&
-            attacked_fields[row][col + 2].empty()) {
-            moves.emplace_back(row, col + 2);
+void Chessboard::PushHistory() {
+    _history[_history_length % HISTORY_SIZE] = _hash;
+    ++_history_length;
+    _history_valid = std::min(_history_valid + 1, HISTORY_SIZE);
+}
+
+
+int Chessboard::CountRepetitions() const {
+    int reversible = std::min(_moves_without_capture_counter, _history_valid - 1);
+    int current = _history_length - 1;
+    int repetitions = 1;
+    for (int back = 2; back <= reversible; back += 2) {
+        if (_history[(current - back) % HISTORY_SIZE] == _hash) {
+            ++repetitions;
         }
+    }
+
+    return repetitions;
+}
 
+
+uint64_t Chessboard::GetHash() const {
+    return _hash;
+}
+
+Bitboard Chessboard::GetMoves(int square, bool only_possible) const {
+    switch (_figures[square]) {
+        case Figure::PAWN:
+            return GetMovesPawn(square, only_possible);
+        case Figure::KNIGHT:
+            return GetMovesKnight(square, only_possible);
+        case Figure::BISHOP:
+            return GetMovesBishop(square, only_possible);
+        case Figure::ROOK:
+            return GetMovesRook(square, only_possible);
+        case Figure::QUEEN:
+            return GetMovesQueen(square, only_possible);
+        case Figure::KING:
+            return GetMovesKing(square, only_possible);
+        default:
+            return 0;
     }
+}
 
-    if ((figure_color == Color::WHITE && _white_can_queenside_castling) ||
-        (figure_color == Color::BLACK && _black_can_queenside_castling)) {
 
-        int row = figure_pos.GetRow();
-        int col = figure_pos.GetCol();
+Bitboard Chessboard::GetMovesPawn(int square, bool only_possible) const {
+    Color figure_color = ColorAt(square);
+    Color enemy_color = Opposite(figure_color);
+    Bitboard attacks = PawnAttacks(figure_color, square);
+    if (!only_possible) {
+        return attacks;
+    }
 
-        for (int i = col - 1; i > 0; --i) {
-            if (_table[row][i].figure != Figure::NOTHING) {
-                second_alpha = false;
-            }
-        }
+    Bitboard empty = ~(_occupied[0] | _occupied[1]);
+    int forward = figure_color == Color::WHITE ? 8 : -8;
+    int start_row = figure_color == Color::WHITE ? 1 : 6;
 
-        if (second_alpha && attacked_fields[row][col].empty() && attacked_fields[row][col - 1].empty() &&
-            attacked_fields[row][col - 2].empty()) {
-            moves.emplace_back(row, col - 2);
+    Bitboard moves = attacks & _occupied[static_cast<int>(enemy_color)];
+    int one_step = square + forward;
+    if (0 <= one_step && one_step < 64 && (empty & SquareBB(one_step))) {
+        moves |= SquareBB(one_step);
+        if (square / 8 == start_row && (empty & SquareBB(one_step + forward))) {
+            moves |= SquareBB(one_step + forward);
         }
+    }
 
+    if (_en_passant_square.has_value()) {
+        int en_passant = SquareOf(*_en_passant_square);
+        int captured = en_passant - forward;
+        if ((attacks & empty & SquareBB(en_passant)) &&
+            (_pieces[static_cast<int>(enemy_color)][static_cast<int>(Figure::PAWN)] & SquareBB(captured))) {
+            moves |= SquareBB(en_passant);
+        }
     }
 
     return moves;
 }
 
 
-std::vector<Coords> Chessboard::GetMovesKing(Coords figure_pos, bool only_possible) {
-    std::vector<Coords> moves;
+Bitboard Chessboard::GetMovesKnight(int square, bool only_possible) const {
+    Bitboard moves = KnightAttacks(square);
+    if (only_possible) {
+        moves &= ~_occupied[static_cast<int>(ColorAt(square))];
+    }
 
-    int row = figure_pos.GetRow();
-    int col = figure_pos.GetCol();
-    Color figure_color = _table[row][col].color;
+    return moves;
+}
 
-    for (int i = 0; i < 8; ++i) {
-        for (int j = 0; j < 8; ++j) {
-            if (abs(row - i) <= 1 && abs(col - j) <= 1) {
-                if (!only_possible || ((_table[i][j].figure == Figure::NOTHING || _table[i][j].color != figure_color)
-                                       && NoCheckAfterMove(figure_pos, Coords(i, j), figure_color))) {
-                    moves.emplace_back(i, j);
-                }
-            }
-        }
+
+Bitboard Chessboard::GetMovesBishop(int square, bool only_possible) const {
+    Bitboard moves = BishopAttacks(square, _occupied[0] | _occupied[1]);
+    if (only_possible) {
+        moves &= ~_occupied[static_cast<int>(ColorAt(square))];
     }
 
+    return moves;
+}
+
+
+Bitboard Chessboard::GetMovesRook(int square, bool only_possible) const {
+    Bitboard moves = RookAttacks(square, _occupied[0] | _occupied[1]);
     if (only_possible) {
-        auto castling_moves = GetCastlingMoves(figure_pos);
-        moves.insert(moves.end(), castling_moves.begin(), castling_moves.end());
+        moves &= ~_occupied[static_cast<int>(ColorAt(square))];
     }
 
     return moves;
 }
 
 
-bool Chessboard::IsMate() {
-    return IsCheck(_current_turn) && IsStaleMate();
+Bitboard Chessboard::GetMovesQueen(int square, bool only_possible) const {
+    return GetMovesBishop(square, only_possible) | GetMovesRook(square, only_possible);
 }
 
 
-bool Chessboard::IsStaleMate() {
-    auto possible_moves = AllPossibleMoves(_current_turn);
-    for (int i = 0; i < 8; ++i) {
-        for (int j = 0; j < 8; ++j) {
-            if (!possible_moves[i][j].empty()) {
-                return false;
-            }
+Bitboard Chessboard::GetCastlingMoves(int square) const {
+    Bitboard moves = 0;
+
+    Color figure_color = ColorAt(square);
+    int row = figure_color == Color::WHITE ? 0 : 7;
+    int king = row * 8 + 4;
+    if (_figures[square] != Figure::KING || square != king) {
+        return moves;
+    }
+
+    bool kingside = figure_color == Color::WHITE ? _white_can_kingside_castling : _black_can_kingside_castling;
+    bool queenside = figure_color == Color::WHITE ? _white_can_queenside_castling : _black_can_queenside_castling;
+    if (!kingside && !queenside) {
+        return moves;
+    }
+
+    Bitboard occupied = _occupied[0] | _occupied[1];
+    Bitboard rooks = _pieces[static_cast<int>(figure_color)][static_cast<int>(Figure::ROOK)];
+    Bitboard attacked_fields = AttackedFields(Opposite(figure_color));
+
+    if (kingside) {
+        Bitboard between = SquareBB(king + 1) | SquareBB(king + 2);
+        if ((rooks & SquareBB(king + 3)) && !(occupied & between) &&
+            !(attacked_fields & (between | SquareBB(king)))) {
+            moves |= SquareBB(king + 2);
         }
     }
 
-    return true;
+    if (queenside) {
+        Bitboard between = SquareBB(king - 1) | SquareBB(king - 2) | SquareBB(king - 3);
+        Bitboard king_path = SquareBB(king) | SquareBB(king - 1) | SquareBB(king - 2);
+        if ((rooks & SquareBB(king - 4)) && !(occupied & between) && !(attacked_fields & king_path)) {
+            moves |= SquareBB(king - 2);
+        }
+    }
+
+    return moves;
+}
+
+
+Bitboard Chessboard::GetMovesKing(int square, bool only_possible) const {
+    Bitboard moves = KingAttacks(square);
+    if (!only_possible) {
+        return moves;
+    }
+
+    return (moves & ~_occupied[static_cast<int>(ColorAt(square))]) | GetCastlingMoves(square);
 }
 
 
-bool Chessboard::IsTripleRepetition() {
+bool Chessboard::IsTripleRepetition() const {
     return _was_triple_repetition;
 }
 
 
-bool Chessboard::IsFiftyMovesWithoutCapture() {
+bool Chessboard::IsFiftyMovesWithoutCapture() const {
     return _moves_without_capture_counter >= 50;
 }
 
@@ -828,10 +1152,10 @@ void Chessboard::Print() {
     for (int i = 7; i >= 0; --i) {
         std::cout << "\033[34m" << std::to_string(i + 1) << "\033[0m ";
         for (int j = 0; j < 8; ++j) {
-            if (_table[i][j].figure == Figure::NOTHING) {
+            if (_figures[i * 8 + j] == Figure::NOTHING) {
                 std::cout << '-';
             } else {
-                std::cout << figure_to_char.at(_table[i][j]);
+                std::cout << FigureChar(ColorAt(i * 8 + j), _figures[i * 8 + j]);
             }
             std::cout << ' ';
         }
@@ -1,13 +1,18 @@
 #pragma once
 
+#include "Bitboard.h"
 #include "Coords.h"
 #include "Figure.h"
+#include "FogEncoder.h"
+#include "MoveList.h"
+#include "PackedPosition.h"
+#include "Zobrist.h"
 
 #include <string>
+#include <string_view>
 #include <array>
+#include <optional>
 #include <vector>
-#include <set>
-#include <unordered_map>
 
 enum class Result {
     IN_PROGRESS,
@@ -18,41 +23,148 @@ enum class Result {
 
 using Table = std::array<std::array<ColoredFigure, 8>, 8>;
 
+/**
+ * Ошибка разбора FEN: номер символа, на котором разбор остановился, и описание
+ */
+struct FenError {
+    size_t position;
+    const char* message;
+};
+
 class Chessboard {
 public:
+    // Размер буфера, в который гарантированно помещается любой FEN (и FEN с "туманом войны")
+    static constexpr size_t FEN_BUFFER_SIZE = 128;
+
     Chessboard() noexcept : Chessboard("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1") { }
-    explicit Chessboard(const std::string& fen);
+    /**
+     * @throws std::invalid_argument, если строка не является корректным FEN
+     */
+    explicit Chessboard(std::string_view fen);
+
+    /**
+     * Заменяет позицию на заданную в FEN. Не выделяет память.
+     * Количество ходов без взятий и номер хода можно опустить.
+     * @return false и описание ошибки в error (если передан), позиция при этом не меняется
+     */
+    bool SetFen(std::string_view fen, FenError* error = nullptr);
+    /**
+     * Записывает FEN позиции в buffer размера size (не меньше FEN_BUFFER_SIZE) без завершающего нуля
+     * @return длина записанной строки, 0 если буфер мал
+     */
+    size_t WriteFen(char* buffer, size_t size) const;
+    std::string GetFen() const;
 
-    const Table& GetTable() const;
+    /**
+     * Упаковывает позицию в 38 байт (см. PackedPosition). Счетчики больше 65535 обрезаются.
+     */
+    PackedPosition Pack() const;
+    /**
+     * Заменяет позицию на упакованную. История ходов и повторений при этом сбрасывается.
+     * @return false, если упакованная позиция некорректна, позиция при этом не меняется
+     */
+    bool Unpack(const PackedPosition& packed);
+
+    Table GetTable() const;
     bool MakeMove(Coords from, Coords to, Figure figure_to_place = Figure::NOTHING);
-    std::string GetFOWFen(Color for_player);
-    enum Result Result();
-    std::array<std::array<std::vector<Coords>, 8>, 8> AllPossibleMoves(Color for_player);
-    enum Color GetCurrentTurn();
+    bool MakeMove(Move move);
+    /**
+     * Ход без проверки легальности (для перебора ходов, полученных из AllPossibleMoves).
+     * Превращение пешки должно быть указано явно.
+     */
+    void MakeMoveUnchecked(const Move& move);
+    /**
+     * Отмена последнего хода по стеку отмены
+     * @return false, если отменять нечего
+     */
+    bool UnmakeMove();
+    // Сделанные ходы по стеку отмены, от позиции последнего SetFen или Unpack
+    void GetPlayedMoves(std::vector<Move>& moves) const;
+    // Глубина стека отмены: ходов, сделанных и не отмененных с последнего SetFen или Unpack
+    size_t GetPlayedMoveCount() const;
+    /**
+     * Снимок для восстановления партии: Unpack(start) и ходы moves по порядку дают эту позицию.
+     * moves - только обратимые ходы после последнего взятия или хода пешкой (и не меньше одного,
+     * если ходы были), чтобы после восстановления работали поиск повторений и отмена хода.
+     */
+    void GetSnapshot(PackedPosition& start, std::vector<Move>& moves) const;
+    std::string GetFOWFen(Color for_player) const;
+    // Как GetFOWFen, но в буфер (см. WriteFen)
+    size_t WriteFOWFen(Color for_player, char* buffer, size_t size) const;
+    FogFrame GetFOWFrame(Color for_player) const;
+    // Окончание FEN после расстановки фигур: очередь хода, рокировки, взятие на проходе, счетчики
+    std::string GetFOWTail() const;
+    // То же в out (не больше 40 символов), возвращает указатель за последним записанным символом
+    char* WriteFOWTail(char* out) const;
+    // Клетки, которые видит игрок в режиме "тумана войны"
+    Bitboard VisibleFields(Color for_player) const;
+    // Результат партии считается при первом запросе и кешируется до следующего хода
+    enum Result Result() const;
+    void AllPossibleMoves(Color for_player, MoveList& moves) const;
+    enum Color GetCurrentTurn() const;
+    uint64_t GetHash() const;
+    // Номер версии позиции, увеличивается с каждым сделанным ходом
+    uint64_t GetVersion() const;
+    // Фигуры одного вида и цвета
+    Bitboard GetPieces(Color color, Figure figure) const;
+    // Фигура на клетке (цвет - через GetPieces), NOTHING если клетка пуста
+    Figure GetFigure(int square) const;
+    bool IsCheck(Color to_player) const;
 private:
 
-    bool IsCheck(Color to_player);
-    bool NoCheckAfterMove(Coords from, Coords to, Color to_player);
-    std::array<std::array<std::vector<Coords>, 8>, 8> ProtectedFields(Color by_player);
+    // работа с битовыми досками
+    void PutFigure(Color color, Figure figure, int square);
+    void RemoveFigure(int square);
+    void MoveFigure(int from, int to);
+    Color ColorAt(int square) const;
+    int KingSquare(Color color) const;
+    Bitboard Attacks(int square, Bitboard occupied) const;
+    Bitboard AttackersTo(int square, Bitboard occupied) const;
+    Bitboard AttackedFields(Color by_player) const;
+
+    /**
+     * Маски для генерации легальных ходов, считаются один раз на позицию:
+     * checkers - фигуры, объявившие шах, pinned - связанные фигуры,
+     * check_mask - клетки, ход на которые закрывает от шаха или берет шахующую фигуру.
+     */
+    struct MoveMasks {
+        int king_square;
+        Bitboard checkers;
+        Bitboard pinned;
+        Bitboard check_mask;
+    };
+    MoveMasks GetMoveMasks(Color for_player) const;
+    Bitboard GetLegalMoves(int square, const MoveMasks& masks) const;
+    // Пересчитывает кеш легальных ходов, если позиция изменилась
+    void UpdateLegalMoves() const;
+    void AddMoves(int from, Bitboard targets, MoveList& moves) const;
+
+    void ProtectedFields(Color by_player, AttackSet& protected_fields) const;
 
-    std::vector<Coords> GetMoves(Coords figure_pos, bool only_possible);
-    std::vector<Coords> GetMovesPawn(Coords figure_pos, bool only_possible);
-    std::vector<Coords> GetMovesKnight(Coords figure_pos, bool only_possible);
-    std::vector<Coords> GetMovesBishop(Coords figure_pos, bool only_possible);
-    std::vector<Coords> GetMovesRook(Coords figure_pos, bool only_possible);
-    std::vector<Coords> GetMovesQueen(Coords figure_pos, bool only_possible);
-    std::vector<Coords> GetCastlingMoves(Coords figure_pos);
-    std::vector<Coords> GetMovesKing(Coords figure_pos, bool only_possible);
+    // only_possible == false - клетки, которые бьет фигура,
+    // only_possible == true - псевдолегальные ходы (без учета шаха своему королю)
+    Bitboard GetMoves(int square, bool only_possible) const;
+    Bitboard GetMovesPawn(int square, bool only_possible) const;
+    Bitboard GetMovesKnight(int square, bool only_possible) const;
+    Bitboard GetMovesBishop(int square, bool only_possible) const;
+    Bitboard GetMovesRook(int square, bool only_possible) const;
+    Bitboard GetMovesQueen(int square, bool only_possible) const;
+    Bitboard GetCastlingMoves(int square) const;
+    Bitboard GetMovesKing(int square, bool only_possible) const;
 
     // функции для проверки на конец партии
-    bool IsMate();
-    bool IsStaleMate();
-    bool IsTripleRepetition();
-    bool IsFiftyMovesWithoutCapture();
+    bool IsTripleRepetition() const;
+    bool IsFiftyMovesWithoutCapture() const;
 
-    struct TableHash {
-        size_t operator() (const Table& table) const noexcept;
-    };
+    // хеширование позиции
+    int CastlingRights() const;
+    void SetCastlingRights(int rights);
+    // Заменяет позицию целиком и сбрасывает историю, общая часть SetFen и Unpack
+    void SetPosition(const std::array<Figure, 64>& figures, Bitboard black, Color current_turn, int castling_rights,
+                     std::optional<Coords> en_passant_square, int moves_without_capture_counter, int moves_counter);
+    uint64_t StateKey() const;
+    void PushHistory();
+    int CountRepetitions() const;
 
     Color _current_turn;
     bool _white_can_kingside_castling;
@@ -63,10 +175,49 @@ private:
     std::optional<Coords> _en_passant_square;
     int _moves_without_capture_counter;
     int _moves_counter;
-    std::unordered_map<Table, int, TableHash> _position_repetitions;
-    Table _table;
+    uint64_t _version;
+    mutable uint64_t _result_version;
+    mutable enum Result _result_cache;
+
+    // Легальные ходы игрока, который сейчас ходит, - один расчет на версию позиции для MakeMove,
+    // Result и AllPossibleMoves. _legal_targets заполнен только для клеток из _legal_from.
+    mutable uint64_t _legal_version;
+    mutable Bitboard _legal_from;
+    mutable Bitboard _legal_checkers;
+    mutable AttackSet _legal_targets;
+
+    // Хеш текущей позиции по Зобристу: фигуры, очередь хода, права на рокировку и взятие на проходе
+    uint64_t _hash;
+
+    // Хеши последних позиций для поиска повторений. Повторение возможно только среди позиций
+    // после последнего взятия или хода пешкой, а их не больше, чем ходов до ничьей по правилу 50 ходов,
+    // поэтому кольцевого буфера на HISTORY_SIZE позиций достаточно.
+    static constexpr int HISTORY_SIZE = 128;
+    std::array<uint64_t, HISTORY_SIZE> _history;
+    int _history_length;
+    // Сколько последних позиций в кольце еще верны: отмена хода не возвращает позицию,
+    // затертую этим ходом, поэтому после отмен дальше этого числа смотреть нельзя
+    int _history_valid;
+
+    // Все, что нельзя восстановить из самого хода при его отмене
+    struct UndoRecord {
+        Move move;
+        Figure moved;
+        Figure captured;
+        uint8_t castling_rights;
+        int8_t en_passant;
+        bool was_triple_repetition;
+        int moves_without_capture;
+        uint64_t hash;
+    };
+    std::vector<UndoRecord> _undo_stack;
+
+    // Позиция: по битовой доске на каждую пару (цвет, фигура) и занятость каждым цветом.
+    // _figures дублирует позицию поклеточно для быстрого ответа "что стоит на клетке".
+    std::array<std::array<Bitboard, 7>, 2> _pieces;
+    std::array<Bitboard, 2> _occupied;
+    std::array<Figure, 64> _figures;
 public:
-    enum Result result_cache;
     // Debug
     void Print();
 };
\ No newline at end of file
@@ -1,13 +1,14 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 
-enum class Color {
+enum class Color : uint8_t {
     WHITE,
     BLACK
 };
 
-enum class Figure {
+enum class Figure : uint8_t {
     NOTHING,
     PAWN,
     KNIGHT,
@@ -0,0 +1,186 @@
+#include "FogEncoder.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FOG_CHESS_X86 1
+#include <immintrin.h>
+#endif
+
+static_assert(sizeof(Figure) == 1, "figures are loaded into vector registers byte by byte");
+
+namespace {
+
+    // Символ клетки по 4-битному коду (фигура, для черных с битом 8), см. PackedPosition
+    alignas(16) constexpr char CODE_CHARS[16] = {
+            '+', 'P', 'N', 'B', 'R', 'Q', 'K', '?',
+            '+', 'p', 'n', 'b', 'r', 'q', 'k', '?'
+    };
+
+    using FiguresKernel = void (*)(const Figure*, Bitboard, Bitboard, char*);
+    using PackedKernel = void (*)(const uint8_t*, Bitboard, char*);
+
+    struct Kernels {
+        FiguresKernel figures;
+        PackedKernel packed;
+        const char* name;
+    };
+
+    void EncodeFiguresScalar(const Figure* figures, Bitboard black, Bitboard visible, char* out) {
+        for (int square = 0; square < 64; ++square) {
+            int code = static_cast<int>(figures[square]) | static_cast<int>((black >> square) & 1) << 3;
+            out[square] = (visible >> square) & 1 ? CODE_CHARS[code] : '-';
+        }
+    }
+
+    void EncodePackedScalar(const uint8_t* squares, Bitboard visible, char* out) {
+        for (int square = 0; square < 64; ++square) {
+            int code = (squares[square / 2] >> (square % 2 * 4)) & 0xF;
+            out[square] = (visible >> square) & 1 ? CODE_CHARS[code] : '-';
+        }
+    }
+
+#ifdef FOG_CHESS_X86
+
+    // 16 бит маски -> 16 байт: 0xFF для установленных битов
+    __attribute__((target("ssse3")))
+    __m128i ExpandMask16(uint32_t bits) {
+        const __m128i spread = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+        const __m128i select = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+        __m128i bytes = _mm_shuffle_epi8(_mm_cvtsi32_si128(static_cast<int>(bits)), spread);
+        return _mm_cmpeq_epi8(_mm_and_si128(bytes, select), select);
+    }
+
+    __attribute__((target("ssse3")))
+    __m128i EncodeCodes16(__m128i codes, uint32_t visible) {
+        const __m128i table = _mm_load_si128(reinterpret_cast<const __m128i*>(CODE_CHARS));
+        const __m128i dash = _mm_set1_epi8('-');
+        __m128i chars = _mm_shuffle_epi8(table, codes);
+        __m128i mask = ExpandMask16(visible);
+        return _mm_or_si128(_mm_and_si128(mask, chars), _mm_andnot_si128(mask, dash));
+    }
+
+    __attribute__((target("ssse3")))
+    void EncodeFiguresSsse3(const Figure* figures, Bitboard black, Bitboard visible, char* out) {
+        const __m128i black_bit = _mm_set1_epi8(8);
+        for (int block = 0; block < 4; ++block) {
+            __m128i codes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(figures + block * 16));
+            uint32_t black_bits = static_cast<uint32_t>(black >> (block * 16)) & 0xFFFF;
+            codes = _mm_or_si128(codes, _mm_and_si128(ExpandMask16(black_bits), black_bit));
+            __m128i chars = EncodeCodes16(codes, static_cast<uint32_t>(visible >> (block * 16)) & 0xFFFF);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + block * 16), chars);
+        }
+    }
+
+    __attribute__((target("ssse3")))
+    void EncodePackedSsse3(const uint8_t* squares, Bitboard visible, char* out) {
+        const __m128i low_nibble = _mm_set1_epi8(0x0F);
+        for (int half = 0; half < 2; ++half) {
+            // 16 байт - 32 клетки: младшие полубайты - четные клетки, старшие - нечетные
+            __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(squares + half * 16));
+            __m128i even = _mm_and_si128(packed, low_nibble);
+            __m128i odd = _mm_and_si128(_mm_srli_epi16(packed, 4), low_nibble);
+            for (int part = 0; part < 2; ++part) {
+                int block = half * 2 + part;
+                __m128i codes = part == 0 ? _mm_unpacklo_epi8(even, odd) : _mm_unpackhi_epi8(even, odd);
+                __m128i chars = EncodeCodes16(codes, static_cast<uint32_t>(visible >> (block * 16)) & 0xFFFF);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + block * 16), chars);
+            }
+        }
+    }
+
+    // 32 бита маски -> 32 байта: 0xFF для установленных битов
+    __attribute__((target("avx2")))
+    __m256i ExpandMask32(uint32_t bits) {
+        const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                                2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+        const __m256i select = _mm256_set1_epi64x(static_cast<int64_t>(0x8040201008040201ULL));
+        __m256i bytes = _mm256_shuffle_epi8(_mm256_set1_epi32(static_cast<int>(bits)), spread);
+        return _mm256_cmpeq_epi8(_mm256_and_si256(bytes, select), select);
+    }
+
+    __attribute__((target("avx2")))
+    __m256i EncodeCodes32(__m256i codes, uint32_t visible) {
+        const __m128i chars = _mm_load_si128(reinterpret_cast<const __m128i*>(CODE_CHARS));
+        const __m256i table = _mm256_broadcastsi128_si256(chars);
+        const __m256i dash = _mm256_set1_epi8('-');
+        return _mm256_blendv_epi8(dash, _mm256_shuffle_epi8(table, codes), ExpandMask32(visible));
+    }
+
+    __attribute__((target("avx2")))
+    void EncodeFiguresAvx2(const Figure* figures, Bitboard black, Bitboard visible, char* out) {
+        const __m256i black_bit = _mm256_set1_epi8(8);
+        for (int block = 0; block < 2; ++block) {
+            __m256i codes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(figures + block * 32));
+            __m256i black_mask = ExpandMask32(static_cast<uint32_t>(black >> (block * 32)));
+            codes = _mm256_or_si256(codes, _mm256_and_si256(black_mask, black_bit));
+            __m256i chars = EncodeCodes32(codes, static_cast<uint32_t>(visible >> (block * 32)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + block * 32), chars);
+        }
+    }
+
+    __attribute__((target("avx2")))
+    void EncodePackedAvx2(const uint8_t* squares, Bitboard visible, char* out) {
+        const __m128i low_nibble = _mm_set1_epi8(0x0F);
+        for (int block = 0; block < 2; ++block) {
+            __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(squares + block * 16));
+            __m128i even = _mm_and_si128(packed, low_nibble);
+            __m128i odd = _mm_and_si128(_mm_srli_epi16(packed, 4), low_nibble);
+            __m256i codes = _mm256_setr_m128i(_mm_unpacklo_epi8(even, odd), _mm_unpackhi_epi8(even, odd));
+            __m256i chars = EncodeCodes32(codes, static_cast<uint32_t>(visible >> (block * 32)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + block * 32), chars);
+        }
+    }
+
+#endif
+
+    Kernels SelectKernels() {
+        const char* limit = std::getenv("FOG_CHESS_SIMD");
+        bool allow_avx2 = limit == nullptr || std::strcmp(limit, "avx2") == 0;
+        bool allow_ssse3 = allow_avx2 || std::strcmp(limit, "ssse3") == 0;
+
+#ifdef FOG_CHESS_X86
+        __builtin_cpu_init();
+        if (allow_avx2 && __builtin_cpu_supports("avx2")) {
+            return {EncodeFiguresAvx2, EncodePackedAvx2, "avx2"};
+        }
+        if (allow_ssse3 && __builtin_cpu_supports("ssse3")) {
+            return {EncodeFiguresSsse3, EncodePackedSsse3, "ssse3"};
+        }
+#else
+        (void) allow_ssse3;
+#endif
+        return {EncodeFiguresScalar, EncodePackedScalar, "scalar"};
+    }
+
+    const Kernels& GetKernels() {
+        static const Kernels kernels = SelectKernels();
+        return kernels;
+    }
+
+}
+
+
+void EncodeFogFrame(const Figure* figures, Bitboard black, Bitboard visible, char* out) {
+    GetKernels().figures(figures, black, visible, out);
+}
+
+
+void EncodeFogFrame(const PackedPosition& position, Bitboard visible, FogFrame& frame) {
+    GetKernels().packed(position.squares.data(), visible, frame.data());
+}
+
+
+void EncodeFogFrames(const PackedPosition* positions, const Bitboard* visible, FogFrame* frames, size_t count) {
+    PackedKernel kernel = GetKernels().packed;
+    for (size_t i = 0; i < count; ++i) {
+        kernel(positions[i].squares.data(), visible[i], frames[i].data());
+    }
+}
+
+
+const char* FogEncoderName() {
+    return GetKernels().name;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "Bitboard.h"
+#include "Figure.h"
+#include "PackedPosition.h"
+
+#include <array>
+#include <cstddef>
+
+// Доска игрока с "туманом войны": по символу на клетку, начиная с A1 по горизонталям.
+// '-' - клетка не видна, '+' - видна и пуста, иначе буква фигуры как в FEN.
+using FogFrame = std::array<char, 64>;
+
+/**
+ * Кодирование кадра "тумана войны" табличной перестановкой байт (pshufb).
+ * Реализация (AVX2, SSSE3 или скалярная) выбирается при первом вызове по возможностям
+ * процессора. Переменная окружения FOG_CHESS_SIMD=scalar|ssse3|avx2 ограничивает выбор сверху.
+ */
+
+// Кадр по фигурам на клетках (Figure по номеру клетки), черным фигурам и видимым клеткам
+void EncodeFogFrame(const Figure* figures, Bitboard black, Bitboard visible, char* out);
+
+// Кадр по упакованной позиции и видимым клеткам
+void EncodeFogFrame(const PackedPosition& position, Bitboard visible, FogFrame& frame);
+
+// Пакетная версия для рассылки многим зрителям: frames[i] по positions[i] и visible[i]
+void EncodeFogFrames(const PackedPosition* positions, const Bitboard* visible, FogFrame* frames, size_t count);
+
+// Название выбранной реализации: "avx2", "ssse3" или "scalar"
+const char* FogEncoderName();
@@ -1,5 +1,8 @@
 #include "Game.h"
 
+#include <algorithm>
+#include <charconv>
+
 Chessboard& Game::GetChessboard() {
     return *chessboard;
 }
@@ -12,6 +15,103 @@ bool Game::CheckPlayerBlacks(unsigned int id) {
     return id == player_blacks;
 }
 
+const char* GameStatusName(GameStatus status) {
+    switch (status) {
+        case GameStatus::NOT_STARTED:
+            return "NOT_STARTED";
+        case GameStatus::ONGOING:
+            return "ONGOING";
+        case GameStatus::FINISHED:
+            return "FINISHED";
+        case GameStatus::ABANDONED:
+            return "ABANDONED";
+    }
+    return "";
+}
+
 GameStatus Game::GetStatus() {
     return status;
-}
\ No newline at end of file
+}
+
+void Game::UpdateStatus() {
+    last_change = std::chrono::steady_clock::now();
+    if (status == GameStatus::ABANDONED) {
+        return;
+    }
+    if (chessboard->Result() != Result::IN_PROGRESS) {
+        status = GameStatus::FINISHED;
+    } else {
+        // Версия только растет, поэтому партия, где отменены все ходы, определяется по стеку отмены
+        status = chessboard->GetPlayedMoveCount() != 0 ? GameStatus::ONGOING : GameStatus::NOT_STARTED;
+    }
+}
+
+void Game::Abandon() {
+    status = GameStatus::ABANDONED;
+    last_change = std::chrono::steady_clock::now();
+}
+
+void Game::Touch() {
+    last_activity = std::chrono::steady_clock::now();
+}
+
+std::chrono::steady_clock::time_point Game::GetLastActivity() const {
+    return last_activity;
+}
+
+std::chrono::steady_clock::time_point Game::GetLastChange() const {
+    return last_change;
+}
+
+std::string Game::GetBoardDelta(Color player, std::optional<uint64_t> since) {
+    uint64_t version = chessboard->GetVersion();
+    FogFrame frame = chessboard->GetFOWFrame(player);
+    FogHistory& history = fog_history[static_cast<int>(player)];
+    const FogFrame* base = since.has_value() ? history.Find(*since) : nullptr;
+
+    // Худший случай - дельта по всем 64 клеткам: "D <v> 64" + 64 * " E4P" + хвост
+    char buffer[512];
+    char* out = buffer;
+    *out++ = base == nullptr ? 'F' : 'D';
+    *out++ = ' ';
+    out = std::to_chars(out, out + 20, version).ptr;
+    *out++ = ' ';
+    if (base == nullptr) {
+        out = std::copy(frame.begin(), frame.end(), out);
+    } else {
+        int changes = 0;
+        for (size_t square = 0; square < frame.size(); ++square) {
+            changes += frame[square] != (*base)[square] ? 1 : 0;
+        }
+
+        out = std::to_chars(out, out + 2, changes).ptr;
+        for (size_t square = 0; square < frame.size(); ++square) {
+            if (frame[square] != (*base)[square]) {
+                *out++ = ' ';
+                *out++ = static_cast<char>('A' + square % 8);
+                *out++ = static_cast<char>('1' + square / 8);
+                *out++ = frame[square];
+            }
+        }
+    }
+    *out++ = ' ';
+    out = chessboard->WriteFOWTail(out);
+
+    history.Add(version, frame);
+    return std::string(buffer, out);
+}
+
+Game::FogHistory::FogHistory() : frames{} {
+    versions.fill(~uint64_t(0));
+}
+
+const FogFrame* Game::FogHistory::Find(uint64_t version) const {
+    size_t slot = version % SIZE;
+    return versions[slot] == version ? &frames[slot] : nullptr;
+}
+
+void Game::FogHistory::Add(uint64_t version, const FogFrame& frame) {
+    size_t slot = version % SIZE;
+    versions[slot] = version;
+    frames[slot] = frame;
+}
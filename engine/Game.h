@@ -2,14 +2,24 @@
 
 #include "Chessboard.h"
 
+#include <array>
+#include <chrono>
 #include <memory>
+#include <optional>
+#include <string>
 
 enum GameStatus {
+    // Ходов еще не было
     NOT_STARTED,
     ONGOING,
-    FINISHED
+    // Есть результат (мат, пат, ничья); отмена хода возвращает партию в ONGOING
+    FINISHED,
+    // Игроки пропали, партия больше не принимает ходов и удаляется
+    ABANDONED
 };
 
+const char* GameStatusName(GameStatus status);
+
 
 class Game {
 public:
@@ -17,15 +27,49 @@ public:
         : chessboard(new Chessboard()),
           player_whites(player_whites),
           player_blacks(player_blacks),
-          status(GameStatus::NOT_STARTED) {}
+          status(GameStatus::NOT_STARTED),
+          last_activity(std::chrono::steady_clock::now()),
+          last_change(last_activity) {}
 
     Chessboard& GetChessboard();
     bool CheckPlayerWhites(unsigned int id);
     bool CheckPlayerBlacks(unsigned int id);
     GameStatus GetStatus();
+    // Пересчитывает status по доске после хода или отмены хода
+    void UpdateStatus();
+    void Abandon();
+
+    // Запрос игрока к партии
+    void Touch();
+    std::chrono::steady_clock::time_point GetLastActivity() const;
+    // Последний ход, отмена хода или смена статуса
+    std::chrono::steady_clock::time_point GetLastChange() const;
+
+    /**
+     * Доска игрока с "туманом войны" относительно версии, которая уже есть у клиента.
+     * Если кадр этой версии еще хранится - "D <версия> <n> <клетка><символ>... <окончание FEN>",
+     * где перечислены только n изменившихся клеток (например, "E4P").
+     * Иначе (первый запрос или клиент слишком отстал) - полный кадр "F <версия> <GetFOWFen>".
+     */
+    std::string GetBoardDelta(Color player, std::optional<uint64_t> since);
 private:
+    // Последние отправленные кадры одного игрока, ячейка выбирается по версии позиции
+    struct FogHistory {
+        static constexpr size_t SIZE = 16;
+
+        FogHistory();
+        const FogFrame* Find(uint64_t version) const;
+        void Add(uint64_t version, const FogFrame& frame);
+
+        std::array<uint64_t, SIZE> versions;
+        std::array<FogFrame, SIZE> frames;
+    };
+
     std::unique_ptr<Chessboard> chessboard;
     unsigned int player_whites;
     unsigned int player_blacks;
     GameStatus status;
+    std::chrono::steady_clock::time_point last_activity;
+    std::chrono::steady_clock::time_point last_change;
+    std::array<FogHistory, 2> fog_history;
 };
\ No newline at end of file
@@ -0,0 +1,5 @@
+#include "MoveList.h"
+
+bool operator == (const Move& lhs, const Move& rhs) {
+    return lhs.from == rhs.from && lhs.to == rhs.to && lhs.promotion == rhs.promotion;
+}
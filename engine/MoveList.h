@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Bitboard.h"
+#include "Figure.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Ход: клетки откуда и куда (номера битов, см. Bitboard.h) и фигура, в которую превращается пешка
+ */
+struct Move {
+    uint8_t from;
+    uint8_t to;
+    Figure promotion;
+};
+
+bool operator == (const Move& lhs, const Move& rhs);
+
+/**
+ * Список фиксированной вместимости на стеке. Не выделяет память в куче,
+ * переполнение не проверяется - вместимость выбирается с запасом под худший случай.
+ */
+template <typename T, size_t Capacity>
+class FixedList {
+public:
+    void Add(const T& value) noexcept {
+        _items[_size++] = value;
+    }
+
+    void Clear() noexcept {
+        _size = 0;
+    }
+
+    size_t Size() const noexcept {
+        return _size;
+    }
+
+    bool Empty() const noexcept {
+        return _size == 0;
+    }
+
+    T& operator[] (size_t i) noexcept {
+        return _items[i];
+    }
+
+    const T& operator[] (size_t i) const noexcept {
+        return _items[i];
+    }
+
+    T* begin() noexcept { return _items.data(); }
+    T* end() noexcept { return _items.data() + _size; }
+    const T* begin() const noexcept { return _items.data(); }
+    const T* end() const noexcept { return _items.data() + _size; }
+private:
+    std::array<T, Capacity> _items;
+    size_t _size = 0;
+};
+
+/**
+ * Все ходы одной позиции. В легальной позиции их не больше 218.
+ */
+using MoveList = FixedList<Move, 256>;
+
+/**
+ * Битовая доска на каждую клетку: например, клетки, которые бьет фигура с этой клетки,
+ * или фигуры, которые бьют эту клетку.
+ */
+class AttackSet {
+public:
+    AttackSet() noexcept : _squares{} {}
+
+    Bitboard& operator[] (int square) noexcept {
+        return _squares[square];
+    }
+
+    Bitboard operator[] (int square) const noexcept {
+        return _squares[square];
+    }
+
+    void Clear() noexcept {
+        _squares.fill(0);
+    }
+private:
+    std::array<Bitboard, 64> _squares;
+};
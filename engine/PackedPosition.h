@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Позиция, упакованная в 38 байт. Подходит для снимков партии, передачи по сети
+ * и в качестве ключа хеш-таблицы: у одной позиции ровно одно представление,
+ * порядок байт не зависит от платформы, выравнивающих байтов нет.
+ */
+struct PackedPosition {
+    static constexpr uint8_t NO_EN_PASSANT = 0xFF;
+
+    // По 4 бита на клетку, две клетки на байт, клетка с меньшим номером в младших битах.
+    // Значение: 0 - пусто, иначе фигура (1..6), для черных с установленным битом 8.
+    std::array<uint8_t, 32> squares;
+    // Бит 0 - ход черных, биты 1..4 - права на рокировку KQkq
+    uint8_t flags;
+    // Клетка, по которой можно взять на проходе, или NO_EN_PASSANT
+    uint8_t en_passant;
+    // Счетчики в порядке little-endian
+    std::array<uint8_t, 2> moves_without_capture;
+    std::array<uint8_t, 2> moves_counter;
+
+    static constexpr size_t SIZE = 38;
+
+    const uint8_t* Data() const {
+        return squares.data();
+    }
+};
+
+static_assert(sizeof(PackedPosition) == PackedPosition::SIZE, "PackedPosition must not contain padding");
+
+inline bool operator==(const PackedPosition& lhs, const PackedPosition& rhs) {
+    return std::memcmp(&lhs, &rhs, sizeof(PackedPosition)) == 0;
+}
+
+inline bool operator!=(const PackedPosition& lhs, const PackedPosition& rhs) {
+    return !(lhs == rhs);
+}
+
+struct PackedPositionHash {
+    size_t operator()(const PackedPosition& position) const noexcept {
+        // Расстановка занимает ровно четыре 64-битных слова, остаток дописываем отдельно
+        uint64_t words[5] = {};
+        std::memcpy(words, &position, sizeof(PackedPosition));
+
+        uint64_t hash = 0;
+        for (uint64_t word : words) {
+            hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+            hash ^= hash >> 32;
+        }
+        return static_cast<size_t>(hash);
+    }
+};
@@ -0,0 +1,393 @@
+#include "Sampler.h"
+
+#include "Zobrist.h"
+
+#include <algorithm>
+#include <cctype>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    constexpr Bitboard LIGHT_SQUARES = 0x55AA55AA55AA55AAULL;
+
+    bool DecodeFigure(char c, Color& color, Figure& figure) {
+        switch (std::tolower(static_cast<unsigned char>(c))) {
+            case 'p':
+                figure = Figure::PAWN;
+                break;
+            case 'n':
+                figure = Figure::KNIGHT;
+                break;
+            case 'b':
+                figure = Figure::BISHOP;
+                break;
+            case 'r':
+                figure = Figure::ROOK;
+                break;
+            case 'q':
+                figure = Figure::QUEEN;
+                break;
+            case 'k':
+                figure = Figure::KING;
+                break;
+            default:
+                return false;
+        }
+        color = std::isupper(static_cast<unsigned char>(c)) ? Color::WHITE : Color::BLACK;
+        return true;
+    }
+
+    void PutCode(PackedPosition& position, int square, Color color, Figure figure) {
+        uint8_t code = static_cast<uint8_t>(figure) | (color == Color::BLACK ? 8 : 0);
+        position.squares[square / 2] |= code << (square % 2 * 4);
+    }
+
+    int RandomBelow(uint64_t& state, int n) {
+        uint64_t random = SplitMix64(state);
+        return static_cast<int>(((random >> 32) * static_cast<uint64_t>(n)) >> 32);
+    }
+
+    // Номер k-го (с нуля) установленного бита: сначала пропускаем целые байты
+    int SelectBit(Bitboard b, int k) {
+        int shift = 0;
+        for (int count = PopCount(b & 0xFF); k >= count; count = PopCount((b >> shift) & 0xFF)) {
+            k -= count;
+            shift += 8;
+        }
+
+        Bitboard byte = (b >> shift) & 0xFF;
+        while (k--) {
+            byte &= byte - 1;
+        }
+        return shift + Lsb(byte);
+    }
+
+    // Вертикали, на которых есть хотя бы одна фигура
+    int FilesOf(Bitboard b) {
+        b |= b >> 32;
+        b |= b >> 16;
+        b |= b >> 8;
+        return static_cast<int>(b & 0xFF);
+    }
+
+    bool ReadNumber(std::string_view& text, int& value) {
+        size_t length = 0;
+        value = 0;
+        while (length < text.size() && length < 9 && std::isdigit(static_cast<unsigned char>(text[length]))) {
+            value = value * 10 + (text[length++] - '0');
+        }
+        text.remove_prefix(length);
+        return length > 0;
+    }
+
+}
+
+
+std::optional<FogView> FogView::Parse(std::string_view fow_fen) {
+    // "<64 клетки> <очередь хода> <рокировки, возможно пустые> <взятие на проходе> <счетчики>"
+    if (fow_fen.size() < 67 || fow_fen[64] != ' ') {
+        return std::nullopt;
+    }
+
+    FogView view{};
+    for (int square = 0; square < 64; ++square) {
+        Color color;
+        Figure figure;
+        char c = fow_fen[square];
+        if (c != '-' && c != '+' && !DecodeFigure(c, color, figure)) {
+            return std::nullopt;
+        }
+        view.frame[square] = c;
+    }
+
+    std::string_view tail = fow_fen.substr(65);
+    if (tail.size() < 2 || (tail[0] != 'w' && tail[0] != 'b') || tail[1] != ' ') {
+        return std::nullopt;
+    }
+    view.turn = tail[0] == 'w' ? Color::WHITE : Color::BLACK;
+    tail.remove_prefix(2);
+
+    for (; !tail.empty() && tail[0] != ' '; tail.remove_prefix(1)) {
+        const char* rights = "KQkq";
+        const char* right = std::char_traits<char>::find(rights, 4, tail[0]);
+        if (right == nullptr) {
+            return std::nullopt;
+        }
+        view.castling_rights |= 1 << (right - rights);
+    }
+    if (tail.size() < 2) {
+        return std::nullopt;
+    }
+    tail.remove_prefix(1);
+
+    view.en_passant = -1;
+    if (tail[0] == '-') {
+        tail.remove_prefix(1);
+    } else {
+        int col = std::toupper(static_cast<unsigned char>(tail[0])) - 'A';
+        int row = tail[1] - '1';
+        if (col < 0 || col >= 8 || (row != 2 && row != 5)) {
+            return std::nullopt;
+        }
+        view.en_passant = row * 8 + col;
+        tail.remove_prefix(2);
+    }
+
+    if (tail.empty() || tail[0] != ' ') {
+        return std::nullopt;
+    }
+    tail.remove_prefix(1);
+    if (!ReadNumber(tail, view.moves_without_capture) || tail.empty() || tail[0] != ' ') {
+        return std::nullopt;
+    }
+    tail.remove_prefix(1);
+    if (!ReadNumber(tail, view.moves_counter) || !tail.empty()) {
+        return std::nullopt;
+    }
+
+    return view;
+}
+
+
+Material MaterialOf(const Chessboard& board, Color color) {
+    Material material{};
+    for (int figure = static_cast<int>(Figure::PAWN); figure <= static_cast<int>(Figure::KING); ++figure) {
+        material[figure] = PopCount(board.GetPieces(color, static_cast<Figure>(figure)));
+    }
+    return material;
+}
+
+
+PositionSampler::PositionSampler(const FogView& view, Color for_player, const Material& enemy_material)
+        : _enemy(Opposite(for_player)), _consistent(true), _base{}, _free(0), _allowed{}, _to_place{},
+          _to_place_count(0), _own_king(-1), _occupied(0), _line_rooks(0), _line_bishops(0), _check_own_king(false),
+          _known_pawns(0), _known_bishops(0), _enemy_captures(0), _check_bishops(false) {
+    // Видимая часть доски
+    Material remaining = enemy_material;
+    remaining[static_cast<int>(Figure::KING)] = 1;
+    int own_pieces = 0;
+    Bitboard enemy_rooks = 0;
+    Bitboard enemy_bishops = 0;
+    for (int square = 0; square < 64; ++square) {
+        Color color;
+        Figure figure;
+        if (view.frame[square] == '-') {
+            _free |= SquareBB(square);
+            continue;
+        }
+        if (!DecodeFigure(view.frame[square], color, figure)) {
+            continue;
+        }
+
+        PutCode(_base, square, color, figure);
+        _occupied |= SquareBB(square);
+        if (color == for_player) {
+            ++own_pieces;
+            _own_king = figure == Figure::KING ? square : _own_king;
+        } else {
+            --remaining[static_cast<int>(figure)];
+            enemy_rooks |= figure == Figure::ROOK || figure == Figure::QUEEN ? SquareBB(square) : 0;
+            enemy_bishops |= figure == Figure::BISHOP || figure == Figure::QUEEN ? SquareBB(square) : 0;
+            _known_pawns |= figure == Figure::PAWN ? SquareBB(square) : 0;
+            _known_bishops |= figure == Figure::BISHOP ? SquareBB(square) : 0;
+        }
+    }
+
+    _base.flags = static_cast<uint8_t>((view.turn == Color::BLACK ? 1 : 0) | view.castling_rights << 1);
+    _base.en_passant = view.en_passant >= 0 ? static_cast<uint8_t>(view.en_passant) : PackedPosition::NO_EN_PASSANT;
+    _base.moves_without_capture = {static_cast<uint8_t>(view.moves_without_capture & 0xFF),
+                                   static_cast<uint8_t>((view.moves_without_capture >> 8) & 0xFF)};
+    _base.moves_counter = {static_cast<uint8_t>(view.moves_counter & 0xFF),
+                           static_cast<uint8_t>((view.moves_counter >> 8) & 0xFF)};
+
+    // Фигуры противника, положение которых следует из окончания FEN
+    auto force = [this, &view, &remaining](Figure figure, int square) {
+        Color color;
+        Figure seen;
+        if (view.frame[square] != '-') {
+            if (!DecodeFigure(view.frame[square], color, seen) || color != _enemy || seen != figure) {
+                _consistent = false;
+            }
+            return;
+        }
+        if (!(_free & SquareBB(square))) {
+            return;
+        }
+
+        PutCode(_base, square, _enemy, figure);
+        _occupied |= SquareBB(square);
+        _free &= ~SquareBB(square);
+        --remaining[static_cast<int>(figure)];
+        _known_pawns |= figure == Figure::PAWN ? SquareBB(square) : 0;
+        _known_bishops |= figure == Figure::BISHOP ? SquareBB(square) : 0;
+    };
+
+    int rights = view.castling_rights >> (_enemy == Color::WHITE ? 0 : 2);
+    int home = _enemy == Color::WHITE ? 0 : 56;
+    if (rights & 3) {
+        force(Figure::KING, home + 4);
+    }
+    if (rights & 1) {
+        force(Figure::ROOK, home + 7);
+    }
+    if (rights & 2) {
+        force(Figure::ROOK, home);
+    }
+
+    // Взятие на проходе возможно только сразу после двойного хода пешки противника
+    if (view.en_passant >= 0 && view.turn == for_player) {
+        bool white_pawn = view.en_passant / 8 == 2;
+        if (white_pawn != (_enemy == Color::WHITE)) {
+            _consistent = false;
+        } else {
+            force(Figure::PAWN, white_pawn ? view.en_passant + 8 : view.en_passant - 8);
+            _free &= ~(SquareBB(view.en_passant) | SquareBB(white_pawn ? view.en_passant - 8 : view.en_passant + 8));
+        }
+    }
+
+    // Фигуры, которые били бы своего короля или стояли бы на его линиях, игрок бы видел
+    _allowed.fill(~Bitboard(0));
+    _allowed[static_cast<int>(Figure::PAWN)] = ~(RANK_1 | RANK_8);
+    if (_own_king >= 0) {
+        Bitboard rook_lines = RookAttacks(_own_king, 0);
+        Bitboard bishop_lines = BishopAttacks(_own_king, 0);
+        _allowed[static_cast<int>(Figure::PAWN)] &= ~PawnAttacks(for_player, _own_king);
+        _allowed[static_cast<int>(Figure::KNIGHT)] &= ~KnightAttacks(_own_king);
+        _allowed[static_cast<int>(Figure::BISHOP)] &= ~bishop_lines;
+        _allowed[static_cast<int>(Figure::ROOK)] &= ~rook_lines;
+        _allowed[static_cast<int>(Figure::QUEEN)] &= ~(rook_lines | bishop_lines);
+        _allowed[static_cast<int>(Figure::KING)] &= ~KingAttacks(_own_king);
+
+        // Если ходит противник, видимые дальнобойные фигуры на линиях короля должны быть закрыты
+        _line_rooks = enemy_rooks & rook_lines;
+        _line_bishops = enemy_bishops & bishop_lines;
+        _check_own_king = view.turn == _enemy && (_line_rooks || _line_bishops);
+    }
+
+    // Король первым, остальные - от самых стесненных к самым свободным
+    for (int figure = static_cast<int>(Figure::PAWN); figure <= static_cast<int>(Figure::KING); ++figure) {
+        if (remaining[figure] < 0) {
+            _consistent = false;
+        }
+        for (int i = 0; i < remaining[figure] && _to_place_count < 16; ++i) {
+            _to_place[_to_place_count++] = static_cast<Figure>(figure);
+        }
+    }
+    std::stable_sort(_to_place.begin(), _to_place.begin() + _to_place_count, [this](Figure lhs, Figure rhs) {
+        if ((lhs == Figure::KING) != (rhs == Figure::KING)) {
+            return lhs == Figure::KING;
+        }
+        return PopCount(_allowed[static_cast<int>(lhs)] & _free) < PopCount(_allowed[static_cast<int>(rhs)] & _free);
+    });
+    if (_to_place_count > PopCount(_free)) {
+        _consistent = false;
+    }
+
+    _enemy_captures = 16 - own_pieces;
+    if (PopCount(_known_pawns) - PopCount(FilesOf(_known_pawns)) > _enemy_captures) {
+        _consistent = false;
+    }
+    _check_bishops = enemy_material[static_cast<int>(Figure::BISHOP)] == 2 &&
+                     enemy_material[static_cast<int>(Figure::PAWN)] == 8;
+}
+
+
+bool PositionSampler::IsConsistent() const {
+    return _consistent;
+}
+
+
+bool PositionSampler::Place(uint64_t& rng_state, PackedPosition& position) const {
+    position = _base;
+    Bitboard free = _free;
+    Bitboard occupied = _occupied;
+    Bitboard pawns = _known_pawns;
+    Bitboard bishops = _known_bishops;
+    for (int i = 0; i < _to_place_count; ++i) {
+        Figure figure = _to_place[i];
+        Bitboard options = _allowed[static_cast<int>(figure)] & free;
+        if (figure == Figure::PAWN && PopCount(pawns) - PopCount(FilesOf(pawns)) >= _enemy_captures) {
+            // Лишних взятий не осталось - только на вертикали без пешек
+            options &= ~(FILE_A * static_cast<Bitboard>(FilesOf(pawns)));
+        } else if (figure == Figure::BISHOP && _check_bishops && bishops) {
+            options &= (bishops & LIGHT_SQUARES) ? ~LIGHT_SQUARES : LIGHT_SQUARES;
+        }
+        if (!options) {
+            return false;
+        }
+
+        int square = SelectBit(options, RandomBelow(rng_state, PopCount(options)));
+        PutCode(position, square, _enemy, figure);
+        free &= ~SquareBB(square);
+        occupied |= SquareBB(square);
+        pawns |= figure == Figure::PAWN ? SquareBB(square) : 0;
+        bishops |= figure == Figure::BISHOP ? SquareBB(square) : 0;
+    }
+
+    if (_check_own_king && ((RookAttacks(_own_king, occupied) & _line_rooks) ||
+                            (BishopAttacks(_own_king, occupied) & _line_bishops))) {
+        return false;
+    }
+
+    // Пешка уходит на другую вертикаль только взятием, а исходные слоны стоят на полях разного цвета
+    if (PopCount(pawns) - PopCount(FilesOf(pawns)) > _enemy_captures) {
+        return false;
+    }
+    return !_check_bishops || PopCount(bishops & LIGHT_SQUARES) == 1;
+}
+
+
+bool PositionSampler::Sample(uint64_t& rng_state, PackedPosition& position, int max_attempts) const {
+    if (!_consistent) {
+        return false;
+    }
+
+    for (int attempt = 0; attempt < max_attempts; ++attempt) {
+        if (Place(rng_state, position)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+size_t PositionSampler::SampleMany(uint64_t seed, PackedPosition* positions, size_t count, unsigned threads) const {
+    threads = std::max(1u, std::min<unsigned>(threads, static_cast<unsigned>(std::max<size_t>(count / 256, 1))));
+    size_t chunk = (count + threads - 1) / threads;
+    std::vector<size_t> written(threads, 0);
+
+    auto sample_chunk = [this, seed, positions, count, chunk, &written](unsigned thread) {
+        uint64_t state = seed;
+        for (unsigned i = 0; i <= thread; ++i) {
+            state = SplitMix64(state);
+        }
+
+        size_t begin = thread * chunk;
+        size_t end = std::min(count, begin + chunk);
+        size_t& done = written[thread];
+        for (size_t i = begin; i < end; ++i) {
+            if (Sample(state, positions[begin + done])) {
+                ++done;
+            }
+        }
+    };
+
+    std::vector<std::thread> helpers;
+    for (unsigned thread = 1; thread < threads; ++thread) {
+        helpers.emplace_back(sample_chunk, thread);
+    }
+    sample_chunk(0);
+    for (std::thread& helper : helpers) {
+        helper.join();
+    }
+
+    // Отбракованные места в середине массива убираем, сдвигая следующие куски
+    size_t total = written[0];
+    for (unsigned thread = 1; thread < threads; ++thread) {
+        PackedPosition* begin = positions + thread * chunk;
+        std::copy(begin, begin + written[thread], positions + total);
+        total += written[thread];
+    }
+    return total;
+}
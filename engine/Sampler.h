@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Bitboard.h"
+#include "Chessboard.h"
+#include "FogEncoder.h"
+#include "PackedPosition.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+/**
+ * Разобранный ответ GetFOWFen: кадр и окончание FEN
+ */
+struct FogView {
+    FogFrame frame;
+    Color turn;
+    int castling_rights;    // маска KQkq, как в PackedPosition
+    int en_passant;         // клетка взятия на проходе или -1
+    int moves_without_capture;
+    int moves_counter;
+
+    static std::optional<FogView> Parse(std::string_view fow_fen);
+};
+
+// Количество фигур игрока на доске по видам (индекс - Figure)
+using Material = std::array<int, 7>;
+
+Material MaterialOf(const Chessboard& board, Color color);
+
+/**
+ * Случайные полные позиции, согласованные с тем, что видит игрок: невидимые клетки
+ * заполняются фигурами противника. Учитываются известный состав фигур противника,
+ * права на рокировку и взятие на проходе, линии своего короля (дальнобойные фигуры на них
+ * всегда видны), горизонтали пешек, сдвоенные пешки (только через взятия) и цвет полей
+ * слонов, пока превращений быть не могло. Ограничения по клеткам собираются один раз
+ * в конструкторе, остальное проверяется отбраковкой.
+ *
+ * История ходов не учитывается: по одному обзору нельзя проверить, что позиция достижима
+ * из сыгранной партии, - это остается на вызывающем (Bot сначала пробует свою память).
+ */
+class PositionSampler {
+public:
+    /**
+     * @param view доска игрока for_player
+     * @param enemy_material фигуры противника на доске, включая видимые (игрок знает, что он взял)
+     */
+    PositionSampler(const FogView& view, Color for_player, const Material& enemy_material);
+
+    // false, если видимой картине не соответствует ни одна позиция
+    bool IsConsistent() const;
+
+    /**
+     * Одна позиция. rng_state - состояние генератора SplitMix64, продвигается при вызове.
+     * @return false, если за max_attempts попыток все позиции отбракованы
+     */
+    bool Sample(uint64_t& rng_state, PackedPosition& position, int max_attempts = 64) const;
+
+    /**
+     * count позиций на threads потоках, у каждого потока свой генератор из seed
+     * @return число записанных позиций (в начале positions)
+     */
+    size_t SampleMany(uint64_t seed, PackedPosition* positions, size_t count, unsigned threads = 1) const;
+private:
+    bool Place(uint64_t& rng_state, PackedPosition& position) const;
+
+    Color _enemy;
+    bool _consistent;
+    // Видимая часть позиции и состояние хода, невидимые клетки пусты
+    PackedPosition _base;
+    // Невидимые клетки, оставшиеся свободными после обязательных расстановок
+    Bitboard _free;
+    // Клетки, на которых может стоять невидимая фигура противника каждого вида
+    std::array<Bitboard, 7> _allowed;
+    // Виды фигур для случайной расстановки, самые стесненные первыми
+    std::array<Figure, 16> _to_place;
+    int _to_place_count;
+    // Свой король, занятые клетки до случайной расстановки и видимые дальнобойные фигуры противника
+    // на линиях короля. Если ходит противник, король не может быть под шахом.
+    int _own_king;
+    Bitboard _occupied;
+    Bitboard _line_rooks;
+    Bitboard _line_bishops;
+    bool _check_own_king;
+    // Уже известные пешки и слоны противника (видимые и расставленные обязательно)
+    Bitboard _known_pawns;
+    Bitboard _known_bishops;
+    // Сколько раз противник мог брать - столько пешек могло сойти со своей вертикали
+    int _enemy_captures;
+    // Оба слона противника исходные и должны стоять на полях разного цвета
+    bool _check_bishops;
+};
@@ -0,0 +1,401 @@
+#include "Search.h"
+
+#include <algorithm>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    constexpr int FIGURE_VALUES[7] = {0, 100, 320, 330, 500, 900, 0};
+
+    // Близость клетки к центру доски: 3 для четырех центральных клеток, 0 для краев
+    constexpr std::array<int, 64> CENTRALITY = [] {
+        std::array<int, 64> table{};
+        for (int square = 0; square < 64; ++square) {
+            int row = square / 8;
+            int col = square % 8;
+            int row_distance = row < 4 ? 3 - row : row - 4;
+            int col_distance = col < 4 ? 3 - col : col - 4;
+            table[square] = 3 - std::max(row_distance, col_distance);
+        }
+        return table;
+    }();
+
+    // Оценки, начиная с которой счет означает мат в известное число ходов
+    constexpr int MATE_BOUND = Searcher::MATE - 256;
+    constexpr int MAX_PLY = 128;
+
+    // Мат хранится в таблице относительно узла, а не корня, иначе он неверен при транспозициях
+    int ToTable(int score, int ply) {
+        return score > MATE_BOUND ? score + ply : score < -MATE_BOUND ? score - ply : score;
+    }
+
+    int FromTable(int score, int ply) {
+        return score > MATE_BOUND ? score - ply : score < -MATE_BOUND ? score + ply : score;
+    }
+
+    int SideScore(const Chessboard& position, Color color) {
+        int score = 0;
+        for (int figure = static_cast<int>(Figure::PAWN); figure <= static_cast<int>(Figure::QUEEN); ++figure) {
+            Bitboard pieces = position.GetPieces(color, static_cast<Figure>(figure));
+            score += FIGURE_VALUES[figure] * PopCount(pieces);
+            while (pieces) {
+                int square = PopLsb(pieces);
+                switch (static_cast<Figure>(figure)) {
+                    case Figure::PAWN:
+                        // Продвижение пешки к полю превращения
+                        score += 6 * (color == Color::WHITE ? square / 8 - 1 : 6 - square / 8);
+                        break;
+                    case Figure::KNIGHT:
+                        score += 8 * CENTRALITY[square];
+                        break;
+                    case Figure::BISHOP:
+                        score += 4 * CENTRALITY[square];
+                        break;
+                    case Figure::QUEEN:
+                        score += 2 * CENTRALITY[square];
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+        return score;
+    }
+
+}
+
+
+TranspositionTable::TranspositionTable(size_t size_mb) {
+    size_t count = 1;
+    while (count * 2 * sizeof(Slot) <= size_mb * 1024 * 1024) {
+        count *= 2;
+    }
+
+    _slots.reset(new Slot[count]);
+    for (size_t i = 0; i < count; ++i) {
+        _slots[i].key.store(0, std::memory_order_relaxed);
+        _slots[i].data.store(0, std::memory_order_relaxed);
+    }
+    _mask = count - 1;
+}
+
+
+bool TranspositionTable::Probe(uint64_t hash, Entry& entry) const {
+    const Slot& slot = _slots[hash & _mask];
+    uint64_t data = slot.data.load(std::memory_order_relaxed);
+    uint64_t key = slot.key.load(std::memory_order_relaxed);
+    if ((key ^ data) != hash || data == 0) {
+        return false;
+    }
+
+    // Упаковка: from 0-5, to 6-11, превращение 12-14, граница 15-16, глубина 17-24, оценка 32-47
+    entry.move.from = static_cast<uint8_t>(data & 63);
+    entry.move.to = static_cast<uint8_t>((data >> 6) & 63);
+    entry.move.promotion = static_cast<Figure>((data >> 12) & 7);
+    entry.bound = static_cast<Bound>((data >> 15) & 3);
+    entry.depth = static_cast<int>((data >> 17) & 255);
+    entry.score = static_cast<int16_t>(static_cast<uint16_t>(data >> 32));
+    return true;
+}
+
+
+void TranspositionTable::Store(uint64_t hash, const Entry& entry) {
+    Slot& slot = _slots[hash & _mask];
+
+    // Более глубокий результат для той же позиции не затираем неточной оценкой
+    uint64_t old_data = slot.data.load(std::memory_order_relaxed);
+    uint64_t old_key = slot.key.load(std::memory_order_relaxed);
+    if ((old_key ^ old_data) == hash && static_cast<int>((old_data >> 17) & 255) > entry.depth &&
+        entry.bound != EXACT) {
+        return;
+    }
+
+    uint64_t data = static_cast<uint64_t>(entry.move.from) |
+                    static_cast<uint64_t>(entry.move.to) << 6 |
+                    static_cast<uint64_t>(entry.move.promotion) << 12 |
+                    static_cast<uint64_t>(entry.bound) << 15 |
+                    static_cast<uint64_t>(std::clamp(entry.depth, 0, 255)) << 17 |
+                    static_cast<uint64_t>(static_cast<uint16_t>(entry.score)) << 32;
+    slot.key.store(hash ^ data, std::memory_order_relaxed);
+    slot.data.store(data, std::memory_order_relaxed);
+}
+
+
+/**
+ * Один поток перебора со своей копией позиции
+ */
+class Searcher::Worker {
+public:
+    Worker(const Chessboard& position, TranspositionTable& table, std::atomic<bool>& stop, Clock::time_point start,
+           Clock::time_point deadline)
+            : _board(position), _table(table), _stop(stop), _start(start), _deadline(deadline), _nodes(0) {}
+
+    // Итеративное углубление; result заполняет только главный поток
+    void Iterate(int max_depth, int id, SearchResult* result) {
+        MoveList ranked;
+        _board.AllPossibleMoves(_board.GetCurrentTurn(), ranked);
+        std::array<int, 256> scores{};
+        std::array<size_t, 256> order{};
+
+        // Вспомогательные потоки начинают с разной глубины, чтобы реже повторять работу главного
+        for (int depth = 1 + id % 2; depth <= max_depth; ++depth) {
+            int alpha = -MATE - 1;
+            int best = -MATE - 1;
+            for (size_t i = 0; i < ranked.Size(); ++i) {
+                _board.MakeMoveUnchecked(ranked[i]);
+                scores[i] = -AlphaBeta(depth - 1, -MATE - 1, -alpha, 1);
+                _board.UnmakeMove();
+                if (_stop.load(std::memory_order_relaxed)) {
+                    return;
+                }
+                best = std::max(best, scores[i]);
+                alpha = std::max(alpha, scores[i]);
+            }
+
+            std::iota(order.begin(), order.begin() + ranked.Size(), 0);
+            std::stable_sort(order.begin(), order.begin() + ranked.Size(), [&scores](size_t lhs, size_t rhs) {
+                return scores[lhs] > scores[rhs];
+            });
+            MoveList sorted;
+            for (size_t i = 0; i < ranked.Size(); ++i) {
+                sorted.Add(ranked[order[i]]);
+            }
+            ranked = sorted;
+
+            if (result != nullptr) {
+                result->ranked = ranked;
+                result->score = best;
+                result->depth = depth;
+
+                // Следующая итерация дольше всех предыдущих вместе, если времени меньше половины - не начинаем
+                bool out_of_time = Clock::now() - _start > (_deadline - _start) / 2;
+                if (out_of_time || best > MATE_BOUND || best < -MATE_BOUND) {
+                    return;
+                }
+            }
+        }
+    }
+
+    uint64_t GetNodes() const {
+        return _nodes;
+    }
+private:
+    bool Stopped() {
+        if ((++_nodes & 2047) == 0 && Clock::now() >= _deadline) {
+            _stop.store(true, std::memory_order_relaxed);
+        }
+        return _stop.load(std::memory_order_relaxed);
+    }
+
+    int AlphaBeta(int depth, int alpha, int beta, int ply) {
+        if (depth <= 0 || ply >= MAX_PLY) {
+            return Quiesce(alpha, beta, ply);
+        }
+        if (Stopped()) {
+            return 0;
+        }
+
+        uint64_t hash = _board.GetHash();
+        TranspositionTable::Entry entry{};
+        bool found = _table.Probe(hash, entry);
+        if (found && entry.depth >= depth) {
+            int score = FromTable(entry.score, ply);
+            if (entry.bound == TranspositionTable::EXACT ||
+                (entry.bound == TranspositionTable::LOWER && score >= beta) ||
+                (entry.bound == TranspositionTable::UPPER && score <= alpha)) {
+                return score;
+            }
+        }
+
+        Color side = _board.GetCurrentTurn();
+        MoveList moves;
+        _board.AllPossibleMoves(side, moves);
+        if (moves.Empty()) {
+            return _board.IsCheck(side) ? -MATE + ply : 0;
+        }
+
+        std::array<int, 256> scores;
+        ScoreMoves(moves, scores, found ? &entry.move : nullptr);
+
+        int original_alpha = alpha;
+        int best = -MATE - 1;
+        Move best_move = moves[0];
+        for (size_t i = 0; i < moves.Size(); ++i) {
+            PickNext(moves, scores, i);
+            _board.MakeMoveUnchecked(moves[i]);
+            int score = -AlphaBeta(depth - 1, -beta, -alpha, ply + 1);
+            _board.UnmakeMove();
+            if (_stop.load(std::memory_order_relaxed)) {
+                return 0;
+            }
+
+            if (score > best) {
+                best = score;
+                best_move = moves[i];
+                alpha = std::max(alpha, score);
+                if (alpha >= beta) {
+                    break;
+                }
+            }
+        }
+
+        TranspositionTable::Bound bound = best >= beta ? TranspositionTable::LOWER
+                : best > original_alpha ? TranspositionTable::EXACT
+                : TranspositionTable::UPPER;
+        _table.Store(hash, {best_move, ToTable(best, ply), depth, bound});
+        return best;
+    }
+
+    // Перебор только взятий и превращений, под шахом - всех ходов
+    int Quiesce(int alpha, int beta, int ply) {
+        if (Stopped()) {
+            return 0;
+        }
+
+        Color side = _board.GetCurrentTurn();
+        bool in_check = _board.IsCheck(side);
+        MoveList moves;
+        _board.AllPossibleMoves(side, moves);
+        if (moves.Empty()) {
+            return in_check ? -MATE + ply : 0;
+        }
+
+        int best = -MATE - 1;
+        if (!in_check || ply >= MAX_PLY) {
+            best = Evaluate(_board);
+            if (best >= beta || ply >= MAX_PLY) {
+                return best;
+            }
+            alpha = std::max(alpha, best);
+        }
+
+        std::array<int, 256> scores;
+        ScoreMoves(moves, scores, nullptr);
+        for (size_t i = 0; i < moves.Size(); ++i) {
+            PickNext(moves, scores, i);
+            if (!in_check && scores[i] <= 0) {
+                break;
+            }
+
+            _board.MakeMoveUnchecked(moves[i]);
+            int score = -Quiesce(-beta, -alpha, ply + 1);
+            _board.UnmakeMove();
+            if (_stop.load(std::memory_order_relaxed)) {
+                return 0;
+            }
+
+            if (score > best) {
+                best = score;
+                alpha = std::max(alpha, score);
+                if (alpha >= beta) {
+                    break;
+                }
+            }
+        }
+
+        return best;
+    }
+
+    // Порядок: ход из таблицы, взятия (ценная жертва дешевой фигурой раньше), превращения, остальные
+    void ScoreMoves(const MoveList& moves, std::array<int, 256>& scores, const Move* table_move) const {
+        for (size_t i = 0; i < moves.Size(); ++i) {
+            const Move& move = moves[i];
+            Figure attacker = _board.GetFigure(move.from);
+            Figure victim = _board.GetFigure(move.to);
+            if (attacker == Figure::PAWN && victim == Figure::NOTHING && move.from % 8 != move.to % 8) {
+                victim = Figure::PAWN;
+            }
+
+            int score = 0;
+            if (table_move != nullptr && move == *table_move) {
+                score = 1000000;
+            } else if (victim != Figure::NOTHING) {
+                score = 10000 + 10 * FIGURE_VALUES[static_cast<int>(victim)] -
+                        FIGURE_VALUES[static_cast<int>(attacker)] / 10;
+            }
+            if (move.promotion != Figure::NOTHING) {
+                score += 9000 + FIGURE_VALUES[static_cast<int>(move.promotion)];
+            }
+            scores[i] = score;
+        }
+    }
+
+    static void PickNext(MoveList& moves, std::array<int, 256>& scores, size_t from) {
+        size_t best = from;
+        for (size_t i = from + 1; i < moves.Size(); ++i) {
+            if (scores[i] > scores[best]) {
+                best = i;
+            }
+        }
+        std::swap(moves[from], moves[best]);
+        std::swap(scores[from], scores[best]);
+    }
+
+    Chessboard _board;
+    TranspositionTable& _table;
+    std::atomic<bool>& _stop;
+    Clock::time_point _start;
+    Clock::time_point _deadline;
+    uint64_t _nodes;
+};
+
+
+Searcher::Searcher(size_t table_size_mb)
+        : _table(table_size_mb), _searches(0), _nodes(0), _depth_sum(0), _microseconds(0) {}
+
+
+SearchResult Searcher::Search(const Chessboard& position, const SearchLimits& limits) {
+    Clock::time_point start = Clock::now();
+
+    SearchResult result;
+    position.AllPossibleMoves(position.GetCurrentTurn(), result.ranked);
+    if (result.ranked.Size() <= 1) {
+        return result;
+    }
+
+    std::atomic<bool> stop{false};
+    int threads = std::max(1, limits.threads);
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.push_back(std::make_unique<Worker>(position, _table, stop, start, start + limits.budget));
+    }
+
+    std::vector<std::thread> helpers;
+    for (int i = 1; i < threads; ++i) {
+        helpers.emplace_back([&workers, &limits, i]() {
+            workers[i]->Iterate(limits.max_depth, i, nullptr);
+        });
+    }
+    workers[0]->Iterate(limits.max_depth, 0, &result);
+    stop.store(true, std::memory_order_relaxed);
+    for (std::thread& helper : helpers) {
+        helper.join();
+    }
+
+    for (const auto& worker : workers) {
+        result.nodes += worker->GetNodes();
+    }
+    result.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+
+    _searches.fetch_add(1, std::memory_order_relaxed);
+    _nodes.fetch_add(result.nodes, std::memory_order_relaxed);
+    _depth_sum.fetch_add(result.depth, std::memory_order_relaxed);
+    _microseconds.fetch_add(result.elapsed.count(), std::memory_order_relaxed);
+    return result;
+}
+
+
+SearchStats Searcher::GetStats() const {
+    return {_searches.load(std::memory_order_relaxed), _nodes.load(std::memory_order_relaxed),
+            _depth_sum.load(std::memory_order_relaxed), _microseconds.load(std::memory_order_relaxed)};
+}
+
+
+int Searcher::Evaluate(const Chessboard& position) {
+    Color side = position.GetCurrentTurn();
+    return SideScore(position, side) - SideScore(position, Opposite(side));
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "Chessboard.h"
+#include "MoveList.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+/**
+ * Таблица транспозиций, общая для всех потоков перебора. Без блокировок:
+ * запись хранит key ^ data и data, поэтому запись, разорванная параллельной
+ * записью другого потока, при чтении просто не совпадет по ключу.
+ */
+class TranspositionTable {
+public:
+    enum Bound : uint8_t {
+        EXACT,
+        LOWER,
+        UPPER
+    };
+
+    struct Entry {
+        Move move;
+        int score;
+        int depth;
+        Bound bound;
+    };
+
+    // size_mb округляется вниз до степени двойки записей
+    explicit TranspositionTable(size_t size_mb);
+
+    bool Probe(uint64_t hash, Entry& entry) const;
+    void Store(uint64_t hash, const Entry& entry);
+private:
+    struct Slot {
+        std::atomic<uint64_t> key;
+        std::atomic<uint64_t> data;
+    };
+
+    std::unique_ptr<Slot[]> _slots;
+    size_t _mask;
+};
+
+struct SearchLimits {
+    int threads = 1;
+    // Время на ход, перебор останавливается по его истечении на всех потоках
+    std::chrono::milliseconds budget{500};
+    int max_depth = 64;
+};
+
+struct SearchResult {
+    // Ходы корня от лучшего к худшему по последней законченной итерации главного потока
+    MoveList ranked;
+    int score = 0;
+    int depth = 0;
+    uint64_t nodes = 0;
+    std::chrono::microseconds elapsed{0};
+};
+
+/**
+ * Суммарная статистика всех переборов с момента запуска
+ */
+struct SearchStats {
+    uint64_t searches;
+    uint64_t nodes;
+    uint64_t depth_sum;
+    uint64_t microseconds;
+};
+
+/**
+ * Перебор с альфа-бета отсечением и итеративным углублением. Потоки перебирают
+ * одну и ту же позицию независимо (каждый на своей копии доски) и обмениваются
+ * результатами только через таблицу транспозиций.
+ */
+class Searcher {
+public:
+    static constexpr int MATE = 30000;
+
+    explicit Searcher(size_t table_size_mb = 16);
+
+    // Можно вызывать из нескольких потоков: переборы идут одновременно и делят таблицу транспозиций
+    SearchResult Search(const Chessboard& position, const SearchLimits& limits);
+    SearchStats GetStats() const;
+
+    // Оценка позиции с точки зрения игрока, который делает ход
+    static int Evaluate(const Chessboard& position);
+private:
+    class Worker;
+
+    TranspositionTable _table;
+
+    std::atomic<uint64_t> _searches;
+    std::atomic<uint64_t> _nodes;
+    std::atomic<uint64_t> _depth_sum;
+    std::atomic<uint64_t> _microseconds;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Случайные ключи для хеширования позиции по Зобристу. Генерируются при компиляции
+ * детерминированным генератором SplitMix64, так что хеш одной и той же позиции
+ * совпадает между запусками сервера.
+ */
+struct ZobristKeys {
+    uint64_t figures[2][7][64];   // [цвет][фигура][клетка], фигура NOTHING не используется
+    uint64_t castling[16];        // по маске прав на рокировку
+    uint64_t en_passant[8];       // по вертикали поля взятия на проходе
+    uint64_t black_to_move;
+};
+
+constexpr uint64_t SplitMix64(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+constexpr ZobristKeys MakeZobristKeys() {
+    ZobristKeys keys{};
+    uint64_t state = 0x5EED0F0C4E55ULL;
+    for (auto& color : keys.figures) {
+        for (auto& figure : color) {
+            for (auto& key : figure) {
+                key = SplitMix64(state);
+            }
+        }
+    }
+    for (auto& key : keys.castling) {
+        key = SplitMix64(state);
+    }
+    for (auto& key : keys.en_passant) {
+        key = SplitMix64(state);
+    }
+    keys.black_to_move = SplitMix64(state);
+
+    return keys;
+}
+
+inline constexpr ZobristKeys ZOBRIST = MakeZobristKeys();
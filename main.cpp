@@ -3,7 +3,5 @@
 int main(int argc, char* argv[])
 {
     Server server;
-    server.Run(argc, argv);
-
-    return 0;
+    return server.Run(argc, argv);
 }
\ No newline at end of file
@@ -0,0 +1,185 @@
+#include "engine/Bot.h"
+#include "engine/Chessboard.h"
+#include "engine/Sampler.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace {
+
+    int failures = 0;
+
+    void Check(bool condition, const std::string& what) {
+        if (!condition) {
+            std::cerr << what << "\n";
+            ++failures;
+        }
+    }
+
+    // Позиции perft --suite и позиции со взятием на проходе и большими счетчиками
+    const char* const POSITIONS[] = {
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+            "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+            "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+            "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+            "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+            "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+            "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+            "4k3/8/8/8/3pP3/8/8/4K2R b K e3 37 290",
+    };
+
+    void CheckRoundTrip(const Chessboard& board) {
+        PackedPosition packed = board.Pack();
+        Chessboard unpacked;
+        Check(unpacked.Unpack(packed), "Unpack rejected " + board.GetFen());
+        Check(unpacked.GetFen() == board.GetFen(), "Pack/Unpack changed " + board.GetFen() + " to " + unpacked.GetFen());
+        Check(unpacked.GetHash() == board.GetHash(), "Pack/Unpack changed the hash of " + board.GetFen());
+        Check(unpacked.Pack() == packed, "Pack is not stable for " + board.GetFen());
+    }
+
+    void PackRoundTrip() {
+        // Сами позиции и все позиции на два полухода вперед: рокировки, взятия на проходе, превращения
+        for (const char* fen : POSITIONS) {
+            Chessboard board(fen);
+            CheckRoundTrip(board);
+            MoveList moves;
+            board.AllPossibleMoves(board.GetCurrentTurn(), moves);
+            for (const Move& move : moves) {
+                board.MakeMoveUnchecked(move);
+                CheckRoundTrip(board);
+                MoveList replies;
+                board.AllPossibleMoves(board.GetCurrentTurn(), replies);
+                for (const Move& reply : replies) {
+                    board.MakeMoveUnchecked(reply);
+                    CheckRoundTrip(board);
+                    board.UnmakeMove();
+                }
+                board.UnmakeMove();
+            }
+        }
+    }
+
+    void SnapshotRestore() {
+        Chessboard board;
+        // 1. e4 e5 2. Nf3 Nc6 3. Ng1 Nb8 4. Nf3 Nc6 5. Ng1 Nb8 - троекратное повторение после 1... e5
+        const Move moves[] = {{12, 28, Figure::NOTHING}, {52, 36, Figure::NOTHING},
+                              {6, 21, Figure::NOTHING}, {57, 42, Figure::NOTHING},
+                              {21, 6, Figure::NOTHING}, {42, 57, Figure::NOTHING},
+                              {6, 21, Figure::NOTHING}, {57, 42, Figure::NOTHING},
+                              {21, 6, Figure::NOTHING}, {42, 57, Figure::NOTHING}};
+        for (size_t played = 0; played <= std::size(moves); ++played) {
+            if (played != 0) {
+                Check(board.MakeMove(moves[played - 1]), "illegal move " + std::to_string(played));
+            }
+
+            PackedPosition start;
+            std::vector<Move> tail;
+            board.GetSnapshot(start, tail);
+            Chessboard restored;
+            Check(restored.Unpack(start), "snapshot start rejected");
+            for (const Move& move : tail) {
+                Check(restored.MakeMove(move), "snapshot move rejected");
+            }
+            Check(restored.GetFen() == board.GetFen(), "snapshot restored " + restored.GetFen() +
+                                                       " instead of " + board.GetFen());
+            Check(restored.Result() == board.Result(), "snapshot changed the result after " + std::to_string(played));
+            Check((played == 0) == (restored.GetPlayedMoveCount() == 0),
+                  "snapshot lost the last move after " + std::to_string(played));
+        }
+        Check(board.Result() == Result::DRAW, "threefold repetition not detected");
+    }
+
+    void BotFirstGuess() {
+        // Первая догадка бота - полная позиция: король и все 16 фигур противника на местах
+        for (Color color : {Color::WHITE, Color::BLACK}) {
+            Chessboard board;
+            if (color == Color::BLACK) {
+                board.MakeMove({12, 28, Figure::NOTHING});
+            }
+            Bot bot(color, std::chrono::milliseconds(10));
+            std::optional<Chessboard> guess = bot.GuessPosition(board.GetFOWFen(color));
+            Check(guess.has_value(), "no first guess");
+            if (!guess.has_value()) {
+                continue;
+            }
+            Color enemy = Opposite(color);
+            Check(PopCount(guess->GetPieces(enemy, Figure::KING)) == 1, "first guess has no enemy king");
+            int pieces = 0;
+            for (int figure = static_cast<int>(Figure::PAWN); figure <= static_cast<int>(Figure::KING); ++figure) {
+                pieces += PopCount(guess->GetPieces(enemy, static_cast<Figure>(figure)));
+            }
+            Check(pieces == 16, "first guess has " + std::to_string(pieces) + " enemy pieces");
+            Check(guess->GetFen() == board.GetFen(), "first guess " + guess->GetFen() + " instead of " + board.GetFen());
+        }
+    }
+
+    void CheckSamples(const Chessboard& board, Color color) {
+        std::string fow_fen = board.GetFOWFen(color);
+        std::optional<FogView> view = FogView::Parse(fow_fen);
+        Check(view.has_value(), "FogView rejected " + fow_fen);
+        if (!view.has_value()) {
+            return;
+        }
+        Color enemy = Opposite(color);
+        Material material = MaterialOf(board, enemy);
+        PositionSampler sampler(*view, color, material);
+        Check(sampler.IsConsistent(), "sampler rejected the view of " + board.GetFen());
+
+        // Каждая позиция дает тот же обзор, тот же состав фигур противника и законна для стороны на ходу
+        std::vector<PackedPosition> positions(512);
+        size_t written = sampler.SampleMany(board.GetHash(), positions.data(), positions.size(), 2);
+        Check(written > 0, "no samples for " + board.GetFen());
+        for (size_t i = 0; i < written; ++i) {
+            Chessboard sampled;
+            if (!sampled.Unpack(positions[i])) {
+                Check(false, "sample rejected by Unpack for " + board.GetFen());
+                continue;
+            }
+            Check(sampled.GetFOWFrame(color) == view->frame, "sample " + sampled.GetFen() +
+                                                             " changes the view of " + board.GetFen());
+            Check(MaterialOf(sampled, enemy) == material, "sample " + sampled.GetFen() +
+                                                          " changes the material of " + board.GetFen());
+            Check(!sampled.IsCheck(Opposite(sampled.GetCurrentTurn())), "sample " + sampled.GetFen() +
+                                                                        " leaves the side not to move in check");
+        }
+    }
+
+    void SamplerConsistency() {
+        // Позиции perft --suite и все позиции на полуход вперед, обзоры обеих сторон. Четвертая
+        // недостижима: у черных сдвоенные пешки на вертикали B, хотя все 16 белых фигур на месте
+        for (const char* fen : POSITIONS) {
+            if (fen == POSITIONS[3]) {
+                continue;
+            }
+            Chessboard board(fen);
+            MoveList moves;
+            board.AllPossibleMoves(board.GetCurrentTurn(), moves);
+            for (size_t i = 0; i <= moves.Size(); ++i) {
+                if (i != 0) {
+                    board.MakeMoveUnchecked(moves[i - 1]);
+                }
+                if (!board.IsCheck(Opposite(board.GetCurrentTurn()))) {
+                    CheckSamples(board, Color::WHITE);
+                    CheckSamples(board, Color::BLACK);
+                }
+                if (i != 0) {
+                    board.UnmakeMove();
+                }
+            }
+        }
+    }
+
+}
+
+int main() {
+    PackRoundTrip();
+    SnapshotRestore();
+    BotFirstGuess();
+    SamplerConsistency();
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
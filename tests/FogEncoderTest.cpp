@@ -0,0 +1,82 @@
+#include "engine/FogEncoder.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+// Запускается по разу на каждое значение FOG_CHESS_SIMD (см. CMakeLists.txt): реализация,
+// выбранная на этом процессоре, должна совпадать с простым посимвольным кодированием байт в байт
+
+namespace {
+
+    int failures = 0;
+
+    constexpr char REFERENCE_CHARS[] = "+PNBRQK?+pnbrqk?";
+
+    FogFrame Reference(const PackedPosition& position, Bitboard visible) {
+        FogFrame frame;
+        for (int square = 0; square < 64; ++square) {
+            int code = (position.squares[square / 2] >> (square % 2 * 4)) & 0xF;
+            frame[square] = (visible >> square) & 1 ? REFERENCE_CHARS[code] : '-';
+        }
+        return frame;
+    }
+
+    void Compare(const FogFrame& expected, const FogFrame& actual, const char* entry_point, int board) {
+        if (expected != actual) {
+            std::cerr << FogEncoderName() << " " << entry_point << " differs on board " << board << ": "
+                      << std::string(expected.begin(), expected.end()) << " != "
+                      << std::string(actual.begin(), actual.end()) << "\n";
+            ++failures;
+        }
+    }
+
+}
+
+int main() {
+    constexpr int BOARDS = 2000;
+    // Коды фигур, которые встречаются в позиции: пусто, белые и черные P..K
+    constexpr uint8_t CODES[] = {0, 1, 2, 3, 4, 5, 6, 9, 10, 11, 12, 13, 14};
+
+    std::mt19937_64 rng(20261017);
+    std::vector<PackedPosition> positions(BOARDS);
+    std::vector<Bitboard> visible(BOARDS);
+    for (int board = 0; board < BOARDS; ++board) {
+        PackedPosition& position = positions[board];
+        position = PackedPosition{};
+        for (int square = 0; square < 64; ++square) {
+            uint8_t code = CODES[rng() % std::size(CODES)];
+            position.squares[square / 2] |= code << (square % 2 * 4);
+        }
+        // Пустая, полная и случайные маски видимости
+        visible[board] = board == 0 ? 0 : board == 1 ? ~Bitboard(0) : (rng() & rng()) | (rng() % 2);
+    }
+
+    std::vector<FogFrame> batch(BOARDS);
+    EncodeFogFrames(positions.data(), visible.data(), batch.data(), BOARDS);
+    for (int board = 0; board < BOARDS; ++board) {
+        FogFrame expected = Reference(positions[board], visible[board]);
+
+        FogFrame packed;
+        EncodeFogFrame(positions[board], visible[board], packed);
+        Compare(expected, packed, "packed", board);
+        Compare(expected, batch[board], "batch", board);
+
+        Figure figures[64];
+        Bitboard black = 0;
+        for (int square = 0; square < 64; ++square) {
+            int code = (positions[board].squares[square / 2] >> (square % 2 * 4)) & 0xF;
+            figures[square] = static_cast<Figure>(code & 7);
+            black |= code & 8 ? SquareBB(square) : 0;
+        }
+        FogFrame from_figures;
+        EncodeFogFrame(figures, black, visible[board], from_figures.data());
+        Compare(expected, from_figures, "figures", board);
+    }
+
+    std::cout << FogEncoderName() << ": " << BOARDS << " boards\n";
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,168 @@
+#include "MoveLog.h"
+#include "engine/Chessboard.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+// Журнал пишется во временный каталог; поток записи MoveLog живет до конца процесса,
+// поэтому журналы создаются через new и не удаляются
+namespace {
+
+    namespace fs = std::filesystem;
+
+    int failures = 0;
+
+    void Check(bool condition, const std::string& what) {
+        if (!condition) {
+            std::cerr << what << "\n";
+            ++failures;
+        }
+    }
+
+    LogRecord MakeRecord(LogRecordType type, unsigned int lobby_id, uint32_t value = 0) {
+        LogRecord record;
+        record.type = type;
+        record.lobby_id = lobby_id;
+        record.value = value;
+        return record;
+    }
+
+    // Ждет, пока последняя запись текущего потока попадет на диск
+    bool Commit(MoveLog& log) {
+        std::promise<bool> durable;
+        std::future<bool> result = durable.get_future();
+        log.AfterCommit(MoveLog::ThreadSequence(), [&durable](bool written) {
+            durable.set_value(written);
+        });
+        return result.get();
+    }
+
+    // Записи, которые повторит новый журнал по тому же пути
+    std::vector<std::string> Replay(const std::string& path) {
+        std::vector<std::string> lines;
+        MoveLog* log = new MoveLog();
+        Check(log->Open(path, [&lines](const LogRecord& record) {
+            lines.push_back(record.Format());
+        }), "cannot reopen " + path);
+        return lines;
+    }
+
+    std::string TestPath(const char* name) {
+        fs::path directory = fs::temp_directory_path() / ("fog_chess_move_log_" + std::to_string(::getpid()));
+        fs::create_directories(directory);
+        return (directory / name).string();
+    }
+
+    void FormatParse() {
+        // Партия с превращением и позицией контрольной точки
+        Chessboard board("rnbqkbnr/pP1ppppp/8/8/8/8/1PPPPPPP/RNBQKBNR w KQkq - 0 5");
+        Check(board.MakeMove({49, 56, Figure::QUEEN}), "promotion rejected");
+        LogRecord game = MakeRecord(LogRecordType::GAME, 6, 250);
+        PackedPosition start;
+        board.GetSnapshot(start, game.moves);
+        game.position = start;
+
+        LogRecord move = MakeRecord(LogRecordType::MOVE, 4);
+        move.move = {12, 28, Figure::NOTHING};
+        LogRecord lobby = MakeRecord(LogRecordType::LOBBY_CREATE, 2);
+        lobby.nickname = "alice";
+        LogRecord from_start = MakeRecord(LogRecordType::GAME, 8);
+        from_start.moves = {{12, 28, Figure::NOTHING}, {52, 36, Figure::NOTHING}};
+        LogRecord next_id = MakeRecord(LogRecordType::NEXT_ID, 0, 10);
+
+        const LogRecord records[] = {next_id, lobby, MakeRecord(LogRecordType::LOBBY_DELETE, 2),
+                                     MakeRecord(LogRecordType::LOBBY_ENTER, 4), MakeRecord(LogRecordType::BOT_GAME, 6, 500),
+                                     move, MakeRecord(LogRecordType::TAKEBACK, 4), MakeRecord(LogRecordType::EVICT, 4),
+                                     game, from_start, MakeRecord(LogRecordType::CHECKPOINT, 0)};
+        for (const LogRecord& record : records) {
+            std::string line = record.Format();
+            LogRecord parsed;
+            Check(LogRecord::Parse(line, parsed), "cannot parse " + line);
+            Check(parsed.Format() == line, "round trip changed " + line + " to " + parsed.Format());
+            Check(parsed.type == record.type && parsed.lobby_id == record.lobby_id && parsed.value == record.value &&
+                  parsed.nickname == record.nickname && parsed.moves.size() == record.moves.size() &&
+                  parsed.position.has_value() == record.position.has_value(), "fields differ after parsing " + line);
+        }
+
+        LogRecord parsed;
+        LogRecord::Parse(game.Format(), parsed);
+        Chessboard restored;
+        Check(parsed.position.has_value() && restored.Unpack(*parsed.position), "snapshot position lost");
+        for (const Move& played : parsed.moves) {
+            Check(restored.MakeMove(played), "snapshot move rejected");
+        }
+        Check(restored.GetFen() == board.GetFen(), "snapshot restored " + restored.GetFen());
+
+        for (const char* damaged : {"", "M 4", "M 4 x", "M 4 32768", "G 6 0 P00", "Q 1", "K 1", "N", "E 4 5"}) {
+            Check(!LogRecord::Parse(damaged, parsed), std::string("damaged record accepted: ") + damaged);
+        }
+    }
+
+    void ReplayAfterCheckpoint() {
+        std::string path = TestPath("checkpoint");
+        MoveLog* log = new MoveLog();
+        Check(log->Open(path, [](const LogRecord&) {}), "cannot open " + path);
+
+        LogRecord move = MakeRecord(LogRecordType::MOVE, 0);
+        move.move = {12, 28, Figure::NOTHING};
+        log->Append(MakeRecord(LogRecordType::LOBBY_ENTER, 0));
+        log->Append(move);
+        Check(Commit(*log), "records before the checkpoint not written");
+
+        // Снимок состояния уходит в новый файл, прежний удаляется после "K"
+        log->BeginCheckpoint();
+        LogRecord game = MakeRecord(LogRecordType::GAME, 0);
+        game.moves = {move.move};
+        log->Append(game);
+        log->EndCheckpoint();
+        LogRecord reply = MakeRecord(LogRecordType::MOVE, 0);
+        reply.move = {52, 36, Figure::NOTHING};
+        log->Append(reply);
+        Check(Commit(*log), "checkpoint not written");
+
+        Check(!fs::exists(path + ".1"), "segment before the checkpoint not removed");
+        Check(fs::exists(path + ".2"), "no segment after the checkpoint");
+        std::vector<std::string> expected = {game.Format(), "K", reply.Format()};
+        Check(Replay(path) == expected, "replay after the checkpoint does not start from the snapshot");
+    }
+
+    void UnfinishedCheckpoint() {
+        // Точка без "K" не отменяет прежний файл: повтор идет с него и продолжается в новом
+        std::string path = TestPath("unfinished");
+        MoveLog* log = new MoveLog();
+        Check(log->Open(path, [](const LogRecord&) {}), "cannot open " + path);
+
+        log->Append(MakeRecord(LogRecordType::LOBBY_ENTER, 0));
+        log->BeginCheckpoint();
+        LogRecord game = MakeRecord(LogRecordType::GAME, 0);
+        log->Append(game);
+        Check(Commit(*log), "records not written");
+        Check(fs::exists(path + ".1") && fs::exists(path + ".2"), "checkpoint did not rotate the segment");
+
+        // Недописанная при сбое строка отбрасывается
+        std::ofstream(path + ".2", std::ios::app) << "M 0 12";
+        std::vector<std::string> expected = {"E 0", game.Format()};
+        Check(Replay(path) == expected, "replay of an unfinished checkpoint lost records");
+
+        std::ifstream file(path + ".2");
+        std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        Check(content == game.Format() + "\n", "damaged tail not truncated");
+    }
+
+}
+
+int main() {
+    FormatParse();
+    ReplayAfterCheckpoint();
+    UnfinishedCheckpoint();
+    std::error_code ec;
+    fs::remove_all(fs::temp_directory_path() / ("fog_chess_move_log_" + std::to_string(::getpid())), ec);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
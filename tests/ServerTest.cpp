@@ -0,0 +1,194 @@
+#include "Server.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Запросы идут прямо в Server::HandleRequest, без сети; ход бота делается синхронно
+class ServerTest {
+public:
+    static void PlayBotMove(Server& server, unsigned int lobby_id) {
+        server.PlayBotMove(lobby_id);
+    }
+};
+
+namespace {
+
+    int failures = 0;
+
+    void Expect(Server& server, const std::string& request, const std::string& expected) {
+        std::string response = server.HandleRequest(request);
+        if (response != expected) {
+            std::cerr << request << ": expected \"" << expected << "\", got \"" << response << "\"\n";
+            ++failures;
+        }
+    }
+
+    void TakebackInBotGame() {
+        Server server;
+        Expect(server, "LOBBY BOT 10", "0");
+        Expect(server, "GAME MOVE 0 E2 E4 -", "+");
+        ServerTest::PlayBotMove(server, 0);
+        Expect(server, "GAME TURN 0", "w");
+
+        // Ход бота отменить нельзя, партия остается на ходе игрока
+        Expect(server, "GAME TAKEBACK 1", "-");
+        Expect(server, "GAME TURN 0", "w");
+        Expect(server, "GAME MOVE 0 D2 D4 -", "+");
+
+        // Бот не соглашается отменить ход игрока
+        Expect(server, "GAME TAKEBACK 0", "-");
+        ServerTest::PlayBotMove(server, 0);
+        Expect(server, "GAME TURN 0", "w");
+    }
+
+    void ConcurrentBotGames() {
+        // Переборы разных партий идут одновременно на общей таблице транспозиций
+        Server server;
+        constexpr unsigned int GAMES = 4;
+        for (unsigned int i = 0; i < GAMES; ++i) {
+            Expect(server, "LOBBY BOT 200", std::to_string(i * 2));
+            Expect(server, "GAME MOVE " + std::to_string(i * 2) + " E2 E4 -", "+");
+        }
+
+        std::vector<std::thread> bots;
+        for (unsigned int i = 0; i < GAMES; ++i) {
+            bots.emplace_back([&server, i]() {
+                ServerTest::PlayBotMove(server, i * 2);
+            });
+        }
+        for (std::thread& bot : bots) {
+            bot.join();
+        }
+
+        for (unsigned int i = 0; i < GAMES; ++i) {
+            Expect(server, "GAME TURN " + std::to_string(i * 2), "w");
+        }
+    }
+
+    void TakebackHandshake() {
+        Server server;
+        Expect(server, "LOBBY CREATE alice", "0");
+        Expect(server, "LOBBY ENTER 0", "1");
+
+        // Ход отменяется, только когда соперник принял предложение
+        Expect(server, "GAME MOVE 0 E2 E4 -", "+");
+        Expect(server, "GAME TAKEBACK 0", "+");
+        Expect(server, "GAME TURN 0", "b");
+        Expect(server, "GAME ACCEPT 0", "-");
+        Expect(server, "GAME ACCEPT 1", "+");
+        Expect(server, "GAME TURN 0", "w");
+        Expect(server, "GAME ACCEPT 1", "-");
+
+        // Ход соперника отменяет предложение
+        Expect(server, "GAME MOVE 0 E2 E4 -", "+");
+        Expect(server, "GAME TAKEBACK 0", "+");
+        Expect(server, "GAME MOVE 1 E7 E5 -", "+");
+        Expect(server, "GAME ACCEPT 1", "-");
+        Expect(server, "GAME TURN 0", "w");
+    }
+
+    void TakebackAfterMate() {
+        Server server;
+        Expect(server, "LOBBY CREATE alice", "0");
+        Expect(server, "LOBBY ENTER 0", "1");
+        Expect(server, "GAME MOVE 0 F2 F3 -", "+");
+        Expect(server, "GAME MOVE 1 E7 E5 -", "+");
+        Expect(server, "GAME MOVE 0 G2 G4 -", "+");
+        Expect(server, "GAME MOVE 1 D8 H4 -", "+");
+        Expect(server, "GAME RESULT 0", "3");
+
+        // Законченную партию отменой мата не продолжить
+        Expect(server, "GAME TAKEBACK 1", "-");
+        Expect(server, "GAME ACCEPT 0", "-");
+        Expect(server, "GAME RESULT 0", "3");
+    }
+
+    void PromotionParsing() {
+        Request request;
+        for (const char* move : {"GAME MOVE 0 A7 A8 Q", "GAME MOVE 0 A7 A8 n", "GAME MOVE 0 E2 E4 -"}) {
+            if (!ParseTextRequest(move, request)) {
+                std::cerr << move << ": rejected\n";
+                ++failures;
+            }
+        }
+        for (const char* move : {"GAME MOVE 0 A7 A8 P", "GAME MOVE 0 A7 A8 K"}) {
+            if (ParseTextRequest(move, request)) {
+                std::cerr << move << ": accepted\n";
+                ++failures;
+            }
+        }
+
+        // u32 game_id = 0, ход A7-A8 с превращением в 0..7: годятся только 0 и KNIGHT..QUEEN
+        for (unsigned int promotion = 0; promotion < 8; ++promotion) {
+            unsigned int move = 48 | 56 << 6 | promotion << 12;
+            std::string message{static_cast<char>(Command::GAME_MOVE), 0, 0, 0, 0,
+                                static_cast<char>(move & 0xFF), static_cast<char>(move >> 8)};
+            bool expected = promotion == 0 || (promotion >= static_cast<unsigned int>(Figure::KNIGHT) &&
+                                               promotion <= static_cast<unsigned int>(Figure::QUEEN));
+            if (ParseBinaryRequest(message, request) != expected) {
+                std::cerr << "binary promotion " << promotion << ": expected " << expected << "\n";
+                ++failures;
+            }
+        }
+    }
+
+    void NicknameParsing() {
+        // Текст и двоичный вид принимают одни и те же ники
+        const std::string long_name(MAX_NICKNAME + 1, 'a');
+        const std::pair<std::string, bool> nicknames[] = {
+                {"alice", true}, {std::string(MAX_NICKNAME, 'a'), true}, {"", false}, {long_name, false},
+                {"al\x01" "ce", false}, {"al\x7F", false}, {"\xD0\xB0", false}};
+        Request request;
+        for (const auto& [nickname, expected] : nicknames) {
+            if (ParseTextRequest("LOBBY CREATE " + nickname, request) != expected) {
+                std::cerr << "text nickname \"" << nickname << "\": expected " << expected << "\n";
+                ++failures;
+            }
+            std::string message = static_cast<char>(Command::LOBBY_CREATE) + nickname;
+            if (ParseBinaryRequest(message, request) != expected) {
+                std::cerr << "binary nickname \"" << nickname << "\": expected " << expected << "\n";
+                ++failures;
+            }
+        }
+    }
+
+    void StatusAfterTakeback() {
+        // Партия, где отменены все ходы, снова не начата, хотя версия доски выросла
+        Game game(0, 1);
+        Chessboard& chessboard = game.GetChessboard();
+        chessboard.MakeMove({12, 28, Figure::NOTHING});
+        game.UpdateStatus();
+        GameStatus played = game.GetStatus();
+        chessboard.UnmakeMove();
+        game.UpdateStatus();
+        if (played != GameStatus::ONGOING || game.GetStatus() != GameStatus::NOT_STARTED) {
+            std::cerr << "status after takeback: " << GameStatusName(played) << " -> "
+                      << GameStatusName(game.GetStatus()) << "\n";
+            ++failures;
+        }
+    }
+
+    void AdminWithoutSession() {
+        // Уровень журнала меняется только из локального соединения
+        Server server;
+        Expect(server, "ADMIN LOG DEBUG", "-");
+        Expect(server, "ADMIN LOG", "-");
+    }
+
+}
+
+int main() {
+    TakebackInBotGame();
+    ConcurrentBotGames();
+    TakebackHandshake();
+    TakebackAfterMate();
+    PromotionParsing();
+    NicknameParsing();
+    StatusAfterTakeback();
+    AdminWithoutSession();
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,192 @@
+#include "../engine/AllocationCounter.h"
+#include "../engine/Chessboard.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    struct ReferencePosition {
+        const char* name;
+        const char* fen;
+        int depth;
+        uint64_t nodes;
+    };
+
+    // Эталонные позиции с известным числом узлов (https://www.chessprogramming.org/Perft_Results)
+    const ReferencePosition reference_positions[] = {
+            {"start",    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",                 5, 4865609},
+            {"kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",     4, 4085603},
+            {"position3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",                               5, 674624},
+            {"position4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",         4, 422333},
+            {"position5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",                4, 2103487},
+            {"position6", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 4, 3894594},
+    };
+
+    uint64_t Perft(Chessboard& board, int depth) {
+        MoveList moves;
+        board.AllPossibleMoves(board.GetCurrentTurn(), moves);
+        if (depth == 1) {
+            return moves.Size();
+        }
+
+        uint64_t nodes = 0;
+        for (const Move& move : moves) {
+            board.MakeMoveUnchecked(move);
+            nodes += Perft(board, depth - 1);
+            board.UnmakeMove();
+        }
+
+        return nodes;
+    }
+
+    std::string MoveToString(const Move& move) {
+        std::string s;
+        for (int square : {move.from, move.to}) {
+            s.push_back(static_cast<char>('a' + square % 8));
+            s.push_back(static_cast<char>('1' + square / 8));
+        }
+        switch (move.promotion) {
+            case Figure::QUEEN:
+                s.push_back('q');
+                break;
+            case Figure::ROOK:
+                s.push_back('r');
+                break;
+            case Figure::BISHOP:
+                s.push_back('b');
+                break;
+            case Figure::KNIGHT:
+                s.push_back('n');
+                break;
+            default:
+                break;
+        }
+
+        return s;
+    }
+
+    /**
+     * Считает perft, раздавая ходы из корня рабочим потокам.
+     * @param divide вывести число узлов для каждого хода из корня
+     */
+    uint64_t ParallelPerft(const Chessboard& board, int depth, unsigned threads, bool divide) {
+        if (depth == 0) {
+            return 1;
+        }
+
+        MoveList moves;
+        board.AllPossibleMoves(board.GetCurrentTurn(), moves);
+        std::vector<uint64_t> counts(moves.Size(), 0);
+        std::atomic<size_t> next_move{0};
+
+        auto worker = [&]() {
+            for (size_t i = next_move++; i < moves.Size(); i = next_move++) {
+                Chessboard child = board;
+                child.MakeMoveUnchecked(moves[i]);
+                counts[i] = depth == 1 ? 1 : Perft(child, depth - 1);
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (unsigned i = 1; i < threads; ++i) {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : pool) {
+            thread.join();
+        }
+
+        uint64_t nodes = 0;
+        for (size_t i = 0; i < moves.Size(); ++i) {
+            if (divide) {
+                std::cout << MoveToString(moves[i]) << ": " << counts[i] << '\n';
+            }
+            nodes += counts[i];
+        }
+
+        return nodes;
+    }
+
+    struct RunResult {
+        uint64_t nodes;
+        double seconds;
+        size_t allocations;
+    };
+
+    RunResult Run(const Chessboard& board, int depth, unsigned threads, bool divide) {
+        size_t allocations_before = AllocationCount();
+        auto start = std::chrono::steady_clock::now();
+        uint64_t nodes = ParallelPerft(board, depth, threads, divide);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        return {nodes, elapsed.count(), AllocationCount() - allocations_before};
+    }
+
+    void PrintStats(const RunResult& result) {
+        std::cout << "nodes " << result.nodes
+                  << " time " << result.seconds << "s"
+                  << " nps " << static_cast<uint64_t>(result.nodes / std::max(result.seconds, 1e-9));
+#ifdef FOG_CHESS_COUNT_ALLOCATIONS
+        std::cout << " allocations " << result.allocations;
+#endif
+        std::cout << std::endl;
+    }
+
+    int RunSuite(unsigned threads) {
+        int failed = 0;
+        for (const auto& position : reference_positions) {
+            RunResult result = Run(Chessboard(position.fen), position.depth, threads, false);
+            bool ok = result.nodes == position.nodes;
+            failed += ok ? 0 : 1;
+
+            std::cout << (ok ? "OK   " : "FAIL ") << position.name << " depth " << position.depth
+                      << " expected " << position.nodes << ' ';
+            PrintStats(result);
+        }
+
+        return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+    int depth = 0;
+    std::string fen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+    bool divide = false;
+    bool suite = false;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--divide")) {
+            divide = true;
+        } else if (!std::strcmp(argv[i], "--suite")) {
+            suite = true;
+        } else if (!std::strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = std::max(1, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--fen") && i + 1 < argc) {
+            fen = argv[++i];
+        } else {
+            depth = std::atoi(argv[i]);
+        }
+    }
+
+    if (suite) {
+        return RunSuite(threads);
+    }
+
+    if (depth <= 0) {
+        std::cerr << "Usage: perft <depth> [--fen \"<fen>\"] [--divide] [--threads N]\n"
+                  << "       perft --suite [--threads N]\n";
+        return EXIT_FAILURE;
+    }
+
+    PrintStats(Run(Chessboard(fen), depth, threads, divide));
+    return EXIT_SUCCESS;
+}